@@ -21,3 +21,48 @@ CPPFLAGS    :=	$(INC_FLAGS) -MMD -MP
 LDFLAGS     :=	-Wl,--gc-sections $(addprefix -l,$(WANTLIBS)) -pthread
 
 -include Makefile.base
+
+# local only, times the snapshot codec and the world buffer fill: make -f Makefile.nix bench
+CODEC_BENCH_SRCS    :=	source/comms.cpp source/sha256.cpp source/wire.cpp source/bitpack.cpp bench/codec_bench.cpp
+VERTEX_BENCH_SRCS   :=	source/globjects.cpp glad/src/glad.c bench/vertex_bench.cpp
+
+.PHONY:	bench
+bench: $(BUILD)/codec_bench $(BUILD)/vertex_bench
+	$(BUILD)/codec_bench
+	$(BUILD)/vertex_bench
+
+$(BUILD)/codec_bench: $(CODEC_BENCH_SRCS:%=$(BUILD)/%.o)
+	$(CXX) -o $@ $^ -pthread
+
+$(BUILD)/vertex_bench: $(VERTEX_BENCH_SRCS:%=$(BUILD)/%.o)
+	$(CXX) -o $@ $^ -ldl -pthread
+
+-include $(BUILD)/bench/codec_bench.cpp.d $(BUILD)/bench/vertex_bench.cpp.d
+
+# local only, needs clang's libFuzzer: make -f Makefile.nix fuzz
+# enet and the GL context are faked in fuzz/, so nothing goes over the network and no window opens
+FUZZ_BUILD      :=	build-fuzz
+FUZZ_CC         :=	clang
+FUZZ_CXX        :=	clang++
+FUZZ_CFLAGS     :=	-g -O1 -pthread -fsanitize=fuzzer-no-link,address,undefined
+FUZZ_CXXFLAGS   :=	$(FUZZ_CFLAGS) -std=c++17
+FUZZ_SRCS       :=	$(filter-out source/main.cpp,$(shell find source glad/src lodepng -name *.cpp -or -name *.c)) fuzz/fake_enet.cpp fuzz/fake_gl.cpp
+FUZZ_OBJS       :=	$(FUZZ_SRCS:%=$(FUZZ_BUILD)/%.o)
+FUZZ_TARGETS    :=	$(FUZZ_BUILD)/server_fuzz $(FUZZ_BUILD)/client_fuzz
+
+.PHONY:	fuzz
+fuzz: $(FUZZ_TARGETS)
+	@echo "Run $(FUZZ_BUILD)/server_fuzz or $(FUZZ_BUILD)/client_fuzz with a corpus directory"
+
+$(FUZZ_BUILD)/%_fuzz: $(FUZZ_BUILD)/fuzz/%_fuzz.cpp.o $(FUZZ_OBJS)
+	$(FUZZ_CXX) -fsanitize=fuzzer,address,undefined -o $@ $^ -lglfw -ldl -lm -pthread
+
+$(FUZZ_BUILD)/%.c.o: %.c
+	@mkdir -p $(dir $@)
+	$(FUZZ_CC) $(CPPFLAGS) $(FUZZ_CFLAGS) -c $< -o $@
+
+$(FUZZ_BUILD)/%.cpp.o: %.cpp
+	@mkdir -p $(dir $@)
+	$(FUZZ_CXX) $(CPPFLAGS) $(FUZZ_CXXFLAGS) -c $< -o $@
+
+-include $(FUZZ_OBJS:.o=.d) $(FUZZ_TARGETS:$(FUZZ_BUILD)/%=$(FUZZ_BUILD)/fuzz/%.cpp.d)
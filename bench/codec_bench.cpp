@@ -0,0 +1,115 @@
+#include "comms.h"
+#include "game_limits.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// times write_packed_player and read_packed_player on whole snapshots of random players, with
+// both quantizations and with or without a baseline, and checks every state comes back the same
+
+namespace {
+    constexpr size_t SNAPSHOTS = 200000;
+    constexpr size_t PLAYERS = Limits::Max::Players;
+
+    uint32_t mask(unsigned bits)
+    {
+        return bits >= 32 ? 0xFFFFFFFF : (uint32_t(1) << bits) - 1;
+    }
+
+    PackedPlayer random_player(std::mt19937& rng, const PlayerQuantization& q)
+    {
+        PackedPlayer p;
+        p.sequence = q.sequence_bits ? rng() & mask(q.sequence_bits) : 0;
+        p.x = rng() & mask(q.position_bits);
+        p.z = rng() & mask(q.position_bits);
+        p.yaw = rng() & mask(q.yaw_bits);
+        p.pitch = rng() & mask(q.pitch_bits);
+        p.looking_at_x = rng() & mask(LOOKING_AT_BITS);
+        p.looking_at_y = rng() & mask(LOOKING_AT_BITS);
+        return p;
+    }
+
+    // what a tick usually looks like against the acked one: some players stood still, the others
+    // moved and looked around but kept their input sequence and target
+    PackedPlayer next_player(std::mt19937& rng, const PackedPlayer& from, const PlayerQuantization& q)
+    {
+        if(rng() % 3 == 0) return from;
+        PackedPlayer p = from;
+        p.x = rng() & mask(q.position_bits);
+        p.z = rng() & mask(q.position_bits);
+        p.yaw = rng() & mask(q.yaw_bits);
+        return p;
+    }
+
+    bool same(const PackedPlayer& a, const PackedPlayer& b)
+    {
+        return a.sequence == b.sequence && a.x == b.x && a.z == b.z && a.yaw == b.yaw && a.pitch == b.pitch
+            && a.looking_at_x == b.looking_at_x && a.looking_at_y == b.looking_at_y;
+    }
+
+    bool run(const char* name, const PlayerQuantization& q, bool with_baseline)
+    {
+        std::mt19937 rng(1234);
+        std::vector<PackedPlayer> baselines(SNAPSHOTS * PLAYERS), states(SNAPSHOTS * PLAYERS), decoded(SNAPSHOTS * PLAYERS);
+        for(size_t i = 0; i < states.size(); ++i)
+        {
+            baselines[i] = random_player(rng, q);
+            states[i] = with_baseline ? next_player(rng, baselines[i], q) : random_player(rng, q);
+        }
+
+        const size_t snapshot_size = packed_players_size(PLAYERS, q);
+        std::vector<unsigned char> out(SNAPSHOTS * snapshot_size);
+        std::vector<size_t> lengths(SNAPSHOTS);
+
+        const auto t0 = std::chrono::steady_clock::now();
+        for(size_t s = 0; s < SNAPSHOTS; ++s)
+        {
+            BitWriter w(out.data() + s * snapshot_size, snapshot_size);
+            for(size_t i = s * PLAYERS; i < (s + 1) * PLAYERS; ++i)
+            {
+                write_packed_player(w, states[i], with_baseline ? &baselines[i] : nullptr, q);
+            }
+            lengths[s] = w.finish();
+        }
+        const auto t1 = std::chrono::steady_clock::now();
+        for(size_t s = 0; s < SNAPSHOTS; ++s)
+        {
+            BitReader r(out.data() + s * snapshot_size, lengths[s]);
+            for(size_t i = s * PLAYERS; i < (s + 1) * PLAYERS; ++i)
+            {
+                decoded[i] = read_packed_player(r, with_baseline ? &baselines[i] : nullptr, q);
+            }
+        }
+        const auto t2 = std::chrono::steady_clock::now();
+
+        size_t bytes = 0, mismatches = 0;
+        for(size_t s = 0; s < SNAPSHOTS; ++s)
+        {
+            bytes += lengths[s];
+        }
+        for(size_t i = 0; i < states.size(); ++i)
+        {
+            mismatches += !same(states[i], decoded[i]);
+        }
+
+        const double players = double(states.size());
+        const double write_ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / players;
+        const double read_ns = std::chrono::duration<double, std::nano>(t2 - t1).count() / players;
+        printf("%-10s %-11s %6.2f B/snapshot %7.2f ns/write %7.2f ns/read %zu mismatches\n",
+            name, with_baseline ? "baseline" : "no baseline", double(bytes) / SNAPSHOTS, write_ns, read_ns, mismatches);
+        return mismatches == 0;
+    }
+}
+
+int main()
+{
+    printf("%zu snapshots of %zu players\n", SNAPSHOTS, PLAYERS);
+    bool ok = true;
+    ok &= run("player", PLAYER_QUANTIZATION, false);
+    ok &= run("player", PLAYER_QUANTIZATION, true);
+    ok &= run("spectator", SPECTATOR_QUANTIZATION, false);
+    ok &= run("spectator", SPECTATOR_QUANTIZATION, true);
+    return ok ? 0 : 1;
+}
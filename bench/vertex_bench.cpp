@@ -0,0 +1,115 @@
+#include "fillers.h"
+#include "game_limits.h"
+
+#include <glm/gtc/packing.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// what filling the world buffers costs on the biggest board, every tile of both layers dirty,
+// for Vertex and for the floats it replaced. the corners are the ones fill_quad_generic writes,
+// into plain memory so no GL context is needed. also checks Vertex's half floats round like glm's
+// and hold what the board and the glyphs need exactly
+
+namespace {
+    constexpr int ROUNDS = 200;
+    constexpr int WIDTH = Limits::Max::Width;
+    constexpr int HEIGHT = Limits::Max::Height;
+    constexpr size_t WORLD_LAYERS = 2;
+    // client.cpp's MyEpsilon, the smallest offset the glyphs are drawn at
+    constexpr float MyEpsilon = 0.00006103515625f;
+
+    // the layout before Vertex was packed
+    struct FloatVertex {
+        glm::vec3 pos;
+        glm::vec2 uv;
+        glm::vec4 col;
+
+        static FloatVertex pack(const glm::vec3& pos, const glm::vec2& uv, const glm::vec4& col)
+        {
+            return FloatVertex{pos, uv, col};
+        }
+    };
+
+    template<typename V>
+    void fill_board(std::vector<V>& out)
+    {
+        size_t v = 0;
+        for(size_t layer = 0; layer < WORLD_LAYERS; ++layer)
+        {
+            for(int y = 0; y < HEIGHT; ++y)
+            {
+                for(int x = 0; x < WIDTH; ++x)
+                {
+                    const PDD3 pos{{x, 0.0f, y + 1.0f}, {1, 0, 0}, {0.0f, 0.0f, 1.0f}};
+                    const PDD2 uv{{0.375f, 0.75f}, {0.125f, 0.0f}, {0.0f, 0.25f}};
+                    const glm::vec4 color{1.0f, 1.0f, 1.0f, 1.0f};
+                    out[v++] = V::pack(pos.p, uv.p, color);
+                    out[v++] = V::pack(pos.p + pos.dr, uv.p + uv.dr, color);
+                    out[v++] = V::pack(pos.p - pos.dd, uv.p - uv.dd, color);
+                    out[v++] = V::pack(pos.p + pos.dr - pos.dd, uv.p + uv.dr - uv.dd, color);
+                }
+            }
+        }
+    }
+
+    template<typename V>
+    void run(const char* name)
+    {
+        const size_t quads = WORLD_LAYERS * WIDTH * HEIGHT;
+        std::vector<V> verts(quads * VERTS_PER_QUAD);
+        fill_board(verts);
+
+        const auto t0 = std::chrono::steady_clock::now();
+        for(int i = 0; i < ROUNDS; ++i)
+        {
+            fill_board(verts);
+        }
+        const auto t1 = std::chrono::steady_clock::now();
+
+        // keeps the fills from being optimized away
+        volatile auto sink = verts.back().pos.x;
+        (void)sink;
+
+        const size_t quad_bytes = VERTS_PER_QUAD * sizeof(V);
+        printf("%-6s %3zu B/quad %5.2f MB upload %6.3f ms/fill\n", name, quad_bytes,
+            double(quads * quad_bytes) / 1e6, std::chrono::duration<double, std::milli>(t1 - t0).count() / ROUNDS);
+    }
+
+    bool exact(float value)
+    {
+        return glm::unpackHalf1x16(Vertex::half(value)) == value;
+    }
+
+    // a spread of bit patterns over every sign, exponent and rounding case
+    bool same_as_glm()
+    {
+        for(uint64_t bits = 0; bits <= 0xFFFFFFFFu; bits += 4093)
+        {
+            float value;
+            const uint32_t b = uint32_t(bits);
+            memcpy(&value, &b, sizeof(value));
+            if(value != value) continue; // glm keeps no payload for nans
+            if(Vertex::half(value) != glm::packHalf1x16(value)) return false;
+        }
+        return true;
+    }
+}
+
+int main()
+{
+    printf("%dx%d board, both world layers\n", WIDTH, HEIGHT);
+    run<FloatVertex>("floats");
+    run<Vertex>("packed");
+
+    bool ok = exact(-MyEpsilon) && exact(MyEpsilon);
+    for(int i = 0; i <= Limits::Max::Width + 1; ++i)
+    {
+        ok &= exact(float(i));
+    }
+    printf("board coordinates and MyEpsilon %s\n", ok ? "are exact" : "are NOT exact");
+    const bool rounding = same_as_glm();
+    printf("half floats %s glm::packHalf\n", rounding ? "match" : "DON'T match");
+    return ok && rounding ? 0 : 1;
+}
@@ -0,0 +1,16 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoord;
+in vec4 VtxColor;
+flat in float SkinLayer;
+
+uniform sampler2DArray skins;
+
+void main()
+{
+	vec4 texel = texture(skins, vec3(TexCoord, SkinLayer)) * VtxColor;
+	if(texel.a < 0.5)
+		discard;
+	FragColor = texel;
+}
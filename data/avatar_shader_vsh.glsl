@@ -0,0 +1,69 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in vec4 aVtxColor;
+layout (location = 3) in mat4 iModel;
+layout (location = 7) in vec4 iColor;
+layout (location = 8) in vec4 iParams;
+
+out vec2 TexCoord;
+out vec4 VtxColor;
+flat out float SkinLayer;
+
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+};
+
+// the avatar buffer holds one cube per part, 6 quads of 4 vertices each:
+// body, left arm, right arm, left leg, right leg, head, then their outer layers in the same order
+const int VERTS_PER_PART = 24;
+const int PARTS = 6;
+const int HEAD = 5;
+const float OUTER_SCALE = 1.125;
+
+const vec3 partOffset[PARTS] = vec3[PARTS](
+    vec3(0.0, -0.35, 0.0),
+    vec3(+0.1875, -0.35, 0.0),
+    vec3(-0.1875, -0.35, 0.0),
+    vec3(+0.0625, -0.7875, 0.0),
+    vec3(-0.0625, -0.7875, 0.0),
+    vec3(0.0, 0.0, 0.0)
+);
+const vec3 partScale[PARTS] = vec3[PARTS](
+    vec3(0.25, 0.45, 0.125),
+    vec3(0.125, 0.45, 0.125),
+    vec3(0.125, 0.45, 0.125),
+    vec3(0.125, 0.425, 0.125),
+    vec3(0.125, 0.425, 0.125),
+    vec3(0.25, 0.25, 0.25)
+);
+// which way each limb swings, opposite ones going opposite ways
+const float partSwing[PARTS] = float[PARTS](0.0, +1.0, -1.0, -1.0, +1.0, 0.0);
+
+mat3 rotate_x(float angle)
+{
+    float c = cos(angle);
+    float s = sin(angle);
+    return mat3(1.0, 0.0, 0.0, 0.0, c, s, 0.0, -s, c);
+}
+
+void main()
+{
+    int part = gl_VertexID / VERTS_PER_PART;
+    int p = part % PARTS;
+    float pitch = iParams.x;
+    float swing = iParams.y;
+    float side = partSwing[p];
+
+    // limbs lift a little and move forward or back with the swing
+    vec3 offset = partOffset[p] + vec3(0.0, abs(side) * sin(abs(swing)) * (0.0625 * 1.5), -side * sin(swing) * 0.25);
+    float angle = p == HEAD ? pitch : side * swing;
+    vec3 scale = partScale[p] * (part >= PARTS ? OUTER_SCALE : 1.0);
+    vec3 local = rotate_x(angle) * (aPos * scale) + offset;
+
+    gl_Position = projection * view * iModel * vec4(local, 1.0f);
+    TexCoord = aTexCoord;
+    VtxColor = aVtxColor * iColor;
+    SkinLayer = iParams.z;
+}
@@ -0,0 +1,24 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in vec4 aVtxColor;
+layout (location = 3) in mat4 iModel;
+layout (location = 7) in vec4 iColor;
+
+out vec2 TexCoord;
+out vec4 VtxColor;
+
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+};
+// instances already placed in clip space, like the minimap's indicators
+uniform bool flatInstances;
+
+void main()
+{
+    vec4 pos = iModel * vec4(aPos, 1.0f);
+    gl_Position = flatInstances ? pos : projection * view * pos;
+    TexCoord = vec2(aTexCoord.x, aTexCoord.y);
+    VtxColor = aVtxColor * iColor;
+}
@@ -8,9 +8,69 @@ in vec4 VtxColor;
 uniform sampler2D texture1;
 uniform vec4 constColor;
 
+// board floor drawn as a single quad: TexCoord spans the whole board,
+// and the tile under it is read from the board state texture
+uniform bool boardMode;
+uniform usampler2D boardState;
+uniform ivec2 boardSize;
+
+const vec3 numberColors[8] = vec3[8](
+    vec3(0.0, 0.0, 1.0),
+    vec3(0.0, 1.0, 0.0),
+    vec3(1.0, 0.0, 0.0),
+    vec3(0.75, 0.0, 0.75),
+    vec3(185.0/255.0, 122.0/255.0, 87.0/255.0),
+    vec3(0.0, 1.0, 1.0),
+    vec3(0.0, 0.0, 0.0),
+    vec3(0.25, 0.25, 0.25)
+);
+
+// same cells as the number glyphs of the text
+vec2 digit_uv(int digit, vec2 f)
+{
+    const vec2 extra = vec2(8.0/1024.0, 8.0/512.0);
+    const vec2 cell = vec2(0.0625, 0.125);
+    int col = (4 + digit) % 8;
+    int row = 1 - (4 + digit) / 8;
+    vec2 lt = vec2(0.5 + cell.x * float(col), cell.y * float(row + 1)) + vec2(extra.x, -extra.y);
+    vec2 delta = cell - 2.0 * extra;
+    return vec2(lt.x + delta.x * (1.0 - f.x), lt.y - delta.y * (1.0 - f.y));
+}
+
+vec4 board_texel()
+{
+    vec2 board = TexCoord * vec2(boardSize);
+    ivec2 tile = clamp(ivec2(floor(board)), ivec2(0), boardSize - 1);
+    vec2 f = board - vec2(tile);
+    uint s = texelFetch(boardState, tile, 0).r;
+
+    // at most 8 neighbours, like the tile buffers
+    bool digit = s >= 49u && s <= 56u; // '1' to '8'
+    bool discovered = digit || s == 32u; // ' '
+    vec2 lower_uv = vec2(0.375 + 0.125 * f.x, (discovered ? 0.5 : 0.75) - 0.25 * (1.0 - f.y));
+    vec4 lower = texture(texture1, lower_uv);
+
+    // sampled outside the branches, a zero tint leaves the tile without anything on top
+    vec2 upper_uv = vec2(0.0);
+    vec4 tint = vec4(0.0);
+    if(digit)
+    {
+        int d = int(s) - 48;
+        upper_uv = digit_uv(d, f);
+        tint = vec4(numberColors[d - 1], 1.0);
+    }
+    else if(s == 102u) // 'f'
+    {
+        upper_uv = vec2(0.375 - 0.125 * (1.0 - f.x), 1.0 - 0.25 * (1.0 - f.y));
+        tint = vec4(1.0);
+    }
+    vec4 upper = texture(texture1, upper_uv) * tint;
+    return upper.a < 0.5 ? lower : upper;
+}
+
 void main()
 {
-	vec4 texel = constColor * (texture(texture1, TexCoord) * VtxColor);
+	vec4 texel = constColor * ((boardMode ? board_texel() : texture(texture1, TexCoord)) * VtxColor);
 	if(texel.a < 0.5)
 		discard;
 	FragColor = texel;
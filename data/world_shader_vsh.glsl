@@ -7,8 +7,10 @@ out vec2 TexCoord;
 out vec4 VtxColor;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+};
 
 void main()
 {
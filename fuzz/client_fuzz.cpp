@@ -0,0 +1,96 @@
+#include "fakes.h"
+
+#include "client.h"
+#include "game_limits.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// the first byte says whether the client spectates and who does the handshake. either the input
+// is every packet from the start, so the init packet is fuzzed too, or the harness sends a valid
+// init and a catch-up stream made from the input to get the client playing, then the rest of the
+// input is packets on whatever channel it picks
+
+namespace {
+    constexpr size_t MAX_FUZZ_PACKET = 2 * CATCHUP_CHUNK_SIZE;
+
+    std::string skin_cache;
+    std::vector<unsigned char> default_skin(SKIN_SIZE * SKIN_SIZE * 4, 0xFF);
+    // the client sends the whole buffer like the menu's
+    char username[MAX_NAME_LEN] = "fuzz";
+
+    int pick(FuzzInput& in, int min, int max)
+    {
+        return min + in.byte() % (max - min + 1);
+    }
+
+    void send_init(MineClient& client, FuzzInput& in, bool spectate, std::vector<std::unique_ptr<char[]>>& chat)
+    {
+        ServerWorldPacketInit init;
+        init.protocol_version = PROTOCOL_VERSION;
+        init.players = pick(in, Limits::Min::Players, Limits::Max::Players);
+        init.your_id = spectate ? SPECTATOR_ID : in.byte() % init.players;
+        init.width = pick(in, Limits::Min::Width, Limits::Max::Width);
+        init.height = pick(in, Limits::Min::Height, Limits::Max::Height);
+        init.bombs = in.u16() % (init.width * init.height + 1);
+        init.rates = ServerRates{in.byte(), in.byte(), in.byte()};
+
+        unsigned char buf[ServerWorldPacketInit::WIRE_SIZE];
+        WireWriter w(buf, sizeof(buf));
+        write_packet(w, init);
+        client.receive_packet(buf, sizeof(buf), CHANNEL_CONTROL, chat);
+
+        // everyone's start data as it comes, then the terrain compressed like the server does it
+        std::vector<unsigned char> stream = in.bytes(init.players * StartDataPacket::WIRE_SIZE);
+        stream.resize(init.players * StartDataPacket::WIRE_SIZE);
+        std::vector<unsigned char> tiles = in.bytes(init.width * init.height);
+        tiles.resize(init.width * init.height, '.');
+        std::vector<unsigned char> terrain;
+        compress_tiles(tiles.data(), tiles.size(), terrain);
+        stream.insert(stream.end(), terrain.begin(), terrain.end());
+
+        for(size_t offset = 0; offset < stream.size(); offset += CATCHUP_CHUNK_SIZE)
+        {
+            const size_t n = std::min(CATCHUP_CHUNK_SIZE, stream.size() - offset);
+            std::vector<unsigned char> packet(StreamChunkPacket::WIRE_SIZE + n);
+            WireWriter cw(packet.data(), packet.size());
+            write_packet(cw, StreamChunkPacket{enet_uint32(stream.size()), enet_uint32(offset)});
+            cw.bytes(stream.data() + offset, n);
+            client.receive_packet(packet.data(), packet.size(), CHANNEL_CONTROL, chat);
+        }
+    }
+}
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv)
+{
+    if(!fake_gl_load()) abort();
+    char dir[] = "/tmp/mines_skin_cacheXXXXXX";
+    if(mkdtemp(dir) == nullptr) abort();
+    skin_cache = dir;
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    FuzzInput in(data, size);
+    const uint8_t mode = in.byte();
+    const bool spectate = mode & 1;
+    std::vector<std::unique_ptr<char[]>> chat;
+
+    {
+        MineClient client("", nullptr, default_skin, {1.0f, 1.0f, 1.0f, 1.0f}, username, spectate, skin_cache);
+        if(mode & 2) send_init(client, in, spectate, chat);
+
+        while(!in.empty())
+        {
+            const enet_uint8 channel = in.byte() % CHANNEL_COUNT;
+            const auto bytes = in.bytes(in.u16() % (MAX_FUZZ_PACKET + 1));
+            client.receive_packet(bytes.data(), bytes.size(), channel, chat);
+        }
+    }
+    fake_enet_release_sent();
+    fake_gl_release_maps();
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include "fakes.h"
+
+#include <enet/enet.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+    // the client's net thread sends while the fuzzer releases
+    std::mutex sent_mutex;
+    std::vector<ENetPacket*> sent;
+}
+
+void fake_enet_release_sent()
+{
+    std::vector<ENetPacket*> held;
+    {
+        std::lock_guard<std::mutex> lock(sent_mutex);
+        held.swap(sent);
+    }
+    for(auto packet : held)
+    {
+        if(--packet->referenceCount == 0) enet_packet_destroy(packet);
+    }
+}
+
+int enet_address_set_host(ENetAddress* address, const char* hostName)
+{
+    address->host = ENET_HOST_TO_NET_32(0x7F000001);
+    return 0;
+}
+
+ENetPacket* enet_packet_create(const void* data, size_t dataLength, enet_uint32 flags)
+{
+    auto packet = static_cast<ENetPacket*>(calloc(1, sizeof(ENetPacket)));
+    packet->flags = flags;
+    packet->dataLength = dataLength;
+    if(flags & ENET_PACKET_FLAG_NO_ALLOCATE)
+    {
+        packet->data = static_cast<enet_uint8*>(const_cast<void*>(data));
+        return packet;
+    }
+    // never zero bytes, so it's always something malloc gave
+    packet->data = static_cast<enet_uint8*>(malloc(dataLength ? dataLength : 1));
+    if(data != nullptr) memcpy(packet->data, data, dataLength);
+    return packet;
+}
+
+void enet_packet_destroy(ENetPacket* packet)
+{
+    if(packet == nullptr) return;
+    if(packet->freeCallback != nullptr) packet->freeCallback(packet);
+    if(!(packet->flags & ENET_PACKET_FLAG_NO_ALLOCATE)) free(packet->data);
+    free(packet);
+}
+
+ENetHost* enet_host_create(const ENetAddress* address, size_t peerCount, size_t channelLimit, enet_uint32 incomingBandwidth, enet_uint32 outgoingBandwidth)
+{
+    auto host = static_cast<ENetHost*>(calloc(1, sizeof(ENetHost)));
+    if(address != nullptr) host->address = *address;
+    host->channelLimit = channelLimit;
+    return host;
+}
+
+void enet_host_destroy(ENetHost* host)
+{
+    if(host == nullptr) return;
+    free(host->peers);
+    free(host);
+}
+
+// the only peer of a client host, it's connected as soon as it's asked to be
+ENetPeer* enet_host_connect(ENetHost* host, const ENetAddress* address, size_t channelCount, enet_uint32 data)
+{
+    auto peer = static_cast<ENetPeer*>(calloc(1, sizeof(ENetPeer)));
+    peer->host = host;
+    peer->address = *address;
+    peer->state = ENET_PEER_STATE_CONNECTED;
+    enet_list_clear(&peer->outgoingCommands);
+    host->peers = peer;
+    host->peerCount = 1;
+    return peer;
+}
+
+// nobody ever answers, a disconnect finishes on the next service
+int enet_host_service(ENetHost* host, ENetEvent* event, enet_uint32 timeout)
+{
+    event->type = ENET_EVENT_TYPE_NONE;
+    event->peer = nullptr;
+    event->packet = nullptr;
+    for(size_t i = 0; i < host->peerCount; ++i)
+    {
+        ENetPeer& peer = host->peers[i];
+        if(peer.state != ENET_PEER_STATE_DISCONNECTING) continue;
+        peer.state = ENET_PEER_STATE_DISCONNECTED;
+        event->type = ENET_EVENT_TYPE_DISCONNECT;
+        event->peer = &peer;
+        return 1;
+    }
+    // a millisecond at most, the client's net thread waits in here all the time
+    if(timeout) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return 0;
+}
+
+void enet_host_flush(ENetHost* host)
+{
+
+}
+
+int enet_peer_send(ENetPeer* peer, enet_uint8 channelID, ENetPacket* packet)
+{
+    std::lock_guard<std::mutex> lock(sent_mutex);
+    packet->referenceCount++;
+    sent.push_back(packet);
+    return 0;
+}
+
+void enet_peer_reset(ENetPeer* peer)
+{
+    peer->state = ENET_PEER_STATE_DISCONNECTED;
+}
+
+void enet_peer_disconnect(ENetPeer* peer, enet_uint32 data)
+{
+    if(peer->state == ENET_PEER_STATE_DISCONNECTED) return;
+    peer->state = ENET_PEER_STATE_DISCONNECTING;
+}
+
+void enet_list_clear(ENetList* list)
+{
+    list->sentinel.next = &list->sentinel;
+    list->sentinel.previous = &list->sentinel;
+}
+
+size_t enet_list_size(ENetList* list)
+{
+    size_t size = 0;
+    for(ENetListIterator it = enet_list_begin(list); it != enet_list_end(list); it = enet_list_next(it))
+    {
+        size++;
+    }
+    return size;
+}
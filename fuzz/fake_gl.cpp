@@ -0,0 +1,190 @@
+#include "fakes.h"
+
+#include <glad/glad.h>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace {
+    GLuint next_name = 1;
+    std::vector<std::unique_ptr<unsigned char[]>> maps;
+    // which buffer each target has bound and how big glBufferData made each, for whole-buffer maps
+    std::map<GLenum, GLuint> bound_buffers;
+    std::map<GLuint, GLsizeiptr> buffer_sizes;
+
+    // a GL function that does nothing, with exactly the type glad calls it through.
+    // whatever it returns is 0 or a null pointer
+    template<typename F>
+    struct Nothing;
+
+    template<typename R, typename... Args>
+    struct Nothing<R (APIENTRYP)(Args...)> {
+        static R APIENTRY call(Args...)
+        {
+            return R();
+        }
+    };
+
+    const GLubyte* APIENTRY get_string(GLenum name)
+    {
+        return reinterpret_cast<const GLubyte*>(name == GL_VERSION ? "3.3" : "");
+    }
+
+    // glad wants at least one extension to call the load a success
+    const GLubyte* APIENTRY get_stringi(GLenum name, GLuint index)
+    {
+        return reinterpret_cast<const GLubyte*>("GL_fake");
+    }
+
+    void APIENTRY get_integerv(GLenum pname, GLint* data)
+    {
+        *data = pname == GL_NUM_EXTENSIONS ? 1 : 0;
+    }
+
+    void APIENTRY gen_names(GLsizei n, GLuint* names)
+    {
+        for(GLsizei i = 0; i < n; ++i)
+        {
+            names[i] = next_name++;
+        }
+    }
+
+    void APIENTRY bind_buffer(GLenum target, GLuint buffer)
+    {
+        bound_buffers[target] = buffer;
+    }
+
+    void APIENTRY buffer_data(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+    {
+        buffer_sizes[bound_buffers[target]] = size;
+    }
+
+    // fresh memory every time, nothing reads it back
+    void* mapped(GLsizeiptr length)
+    {
+        maps.push_back(std::make_unique<unsigned char[]>(length ? length : 1));
+        return maps.back().get();
+    }
+
+    void* APIENTRY map_buffer(GLenum target, GLenum access)
+    {
+        return mapped(buffer_sizes[bound_buffers[target]]);
+    }
+
+    void* APIENTRY map_buffer_range(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+    {
+        return mapped(length);
+    }
+
+    struct Entry {
+        const char* name;
+        void* proc;
+    };
+
+    // only converts when f has the type glad stores it as
+    template<typename F>
+    Entry entry(const char* name, F f)
+    {
+        return Entry{name, reinterpret_cast<void*>(f)};
+    }
+
+    #define GL_NOTHING(name) entry<decltype(glad_##name)>(#name, &Nothing<decltype(glad_##name)>::call)
+
+    // everything the game calls, anything else glad leaves null
+    const Entry entries[] = {
+        entry<PFNGLGETSTRINGPROC>("glGetString", get_string),
+        entry<PFNGLGETSTRINGIPROC>("glGetStringi", get_stringi),
+        entry<PFNGLGETINTEGERVPROC>("glGetIntegerv", get_integerv),
+        entry<PFNGLBINDBUFFERPROC>("glBindBuffer", bind_buffer),
+        entry<PFNGLBUFFERDATAPROC>("glBufferData", buffer_data),
+        entry<PFNGLMAPBUFFERPROC>("glMapBuffer", map_buffer),
+        entry<PFNGLMAPBUFFERRANGEPROC>("glMapBufferRange", map_buffer_range),
+        entry<PFNGLGENBUFFERSPROC>("glGenBuffers", gen_names),
+        entry<PFNGLGENFRAMEBUFFERSPROC>("glGenFramebuffers", gen_names),
+        entry<PFNGLGENTEXTURESPROC>("glGenTextures", gen_names),
+        entry<PFNGLGENVERTEXARRAYSPROC>("glGenVertexArrays", gen_names),
+        GL_NOTHING(glActiveTexture),
+        GL_NOTHING(glAttachShader),
+        GL_NOTHING(glBindBufferBase),
+        GL_NOTHING(glBindFramebuffer),
+        GL_NOTHING(glBindTexture),
+        GL_NOTHING(glBindVertexArray),
+        GL_NOTHING(glBlendFunc),
+        GL_NOTHING(glBufferSubData),
+        GL_NOTHING(glClear),
+        GL_NOTHING(glClearColor),
+        GL_NOTHING(glCompileShader),
+        GL_NOTHING(glCreateProgram),
+        GL_NOTHING(glCreateShader),
+        GL_NOTHING(glDeleteBuffers),
+        GL_NOTHING(glDeleteFramebuffers),
+        GL_NOTHING(glDeleteProgram),
+        GL_NOTHING(glDeleteShader),
+        GL_NOTHING(glDeleteTextures),
+        GL_NOTHING(glDeleteVertexArrays),
+        GL_NOTHING(glDisable),
+        GL_NOTHING(glDrawArrays),
+        GL_NOTHING(glDrawElements),
+        GL_NOTHING(glDrawElementsInstanced),
+        GL_NOTHING(glEnable),
+        GL_NOTHING(glEnableVertexAttribArray),
+        GL_NOTHING(glFramebufferTexture2D),
+        GL_NOTHING(glGenerateMipmap),
+        GL_NOTHING(glGetError),
+        GL_NOTHING(glGetProgramInfoLog),
+        GL_NOTHING(glGetProgramiv),
+        GL_NOTHING(glGetShaderInfoLog),
+        GL_NOTHING(glGetShaderiv),
+        GL_NOTHING(glGetUniformBlockIndex),
+        GL_NOTHING(glGetUniformLocation),
+        GL_NOTHING(glLinkProgram),
+        GL_NOTHING(glPixelStorei),
+        GL_NOTHING(glScissor),
+        GL_NOTHING(glShaderSource),
+        GL_NOTHING(glTexImage2D),
+        GL_NOTHING(glTexImage3D),
+        GL_NOTHING(glTexParameteri),
+        GL_NOTHING(glTexSubImage2D),
+        GL_NOTHING(glTexSubImage3D),
+        GL_NOTHING(glUniform1f),
+        GL_NOTHING(glUniform1i),
+        GL_NOTHING(glUniform2f),
+        GL_NOTHING(glUniform2fv),
+        GL_NOTHING(glUniform2i),
+        GL_NOTHING(glUniform3f),
+        GL_NOTHING(glUniform3fv),
+        GL_NOTHING(glUniform4f),
+        GL_NOTHING(glUniform4fv),
+        GL_NOTHING(glUniformBlockBinding),
+        GL_NOTHING(glUniformMatrix2fv),
+        GL_NOTHING(glUniformMatrix3fv),
+        GL_NOTHING(glUniformMatrix4fv),
+        GL_NOTHING(glUnmapBuffer),
+        GL_NOTHING(glUseProgram),
+        GL_NOTHING(glVertexAttribDivisor),
+        GL_NOTHING(glVertexAttribPointer),
+        GL_NOTHING(glViewport),
+    };
+
+    #undef GL_NOTHING
+
+    void* load(const char* name)
+    {
+        for(const auto& e : entries)
+        {
+            if(strcmp(name, e.name) == 0) return e.proc;
+        }
+        return nullptr;
+    }
+}
+
+bool fake_gl_load()
+{
+    return gladLoadGLLoader(load) != 0;
+}
+
+void fake_gl_release_maps()
+{
+    maps.clear();
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// what the fuzzers link instead of enet and a GL context. nothing goes over the network or to a GPU,
+// sent packets are held like enet holds them until they're acked, then let go all at once
+
+// drops the references sends took, every packet nobody else holds is destroyed
+void fake_enet_release_sent();
+// points glad at functions that do nothing, except handing out names and mapping buffers to memory
+bool fake_gl_load();
+// frees the memory buffers were mapped to
+void fake_gl_release_maps();
+
+// reads the fuzzer's input front to back, running out gives zeros
+struct FuzzInput {
+    FuzzInput(const uint8_t* d, size_t s)
+    :
+    data(d), size(s)
+    {
+
+    }
+
+    bool empty() const
+    {
+        return size == 0;
+    }
+
+    uint8_t byte()
+    {
+        if(size == 0) return 0;
+        size--;
+        return *data++;
+    }
+
+    uint16_t u16()
+    {
+        const uint16_t lo = byte();
+        return lo | (uint16_t(byte()) << 8);
+    }
+
+    uint32_t u32()
+    {
+        const uint32_t lo = u16();
+        return lo | (uint32_t(u16()) << 16);
+    }
+
+    // at most max bytes, fewer when the input is shorter
+    std::vector<unsigned char> bytes(size_t max)
+    {
+        const size_t n = max < size ? max : size;
+        std::vector<unsigned char> out(data, data + n);
+        data += n;
+        size -= n;
+        return out;
+    }
+
+private:
+    const uint8_t* data;
+    size_t size;
+};
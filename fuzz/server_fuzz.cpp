@@ -0,0 +1,103 @@
+#include "fakes.h"
+
+#include "server.h"
+#include "game_limits.h"
+
+#include <array>
+#include <cstring>
+
+// the input picks the room, then is a list of events for a few fake peers: connects with any
+// connect data, packets on any channel, disconnects and server ticks. events only come the way
+// enet would give them, nothing from a peer that isn't connected
+
+namespace {
+    constexpr size_t FUZZ_PEERS = 8;
+    constexpr size_t MAX_FUZZ_PACKET = 2 * CATCHUP_CHUNK_SIZE;
+
+    int pick(FuzzInput& in, int min, int max)
+    {
+        return min + in.byte() % (max - min + 1);
+    }
+
+    void reset_peer(ENetPeer& peer)
+    {
+        memset(&peer, 0, sizeof(peer));
+        enet_list_clear(&peer.outgoingCommands);
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    FuzzInput in(data, size);
+
+    const int width = pick(in, Limits::Min::Width, Limits::Max::Width);
+    const int height = pick(in, Limits::Min::Height, Limits::Max::Height);
+    const int bombs_percent = pick(in, Limits::Min::BombPercent, Limits::Max::BombPercent);
+    const int players = pick(in, Limits::Min::Players, Limits::Max::Players);
+    const int spectators = pick(in, Limits::Min::Spectators, 4);
+    const int spectator_rate = pick(in, Limits::Min::SpectatorRate, Limits::Max::SpectatorRate);
+    const ServerRates rates{
+        (unsigned char)pick(in, Limits::Min::TickRate, Limits::Max::TickRate),
+        (unsigned char)pick(in, Limits::Min::SnapshotRate, Limits::Max::SnapshotRate),
+        (unsigned char)pick(in, Limits::Min::InputRate, Limits::Max::InputRate),
+    };
+
+    std::array<ENetPeer, FUZZ_PEERS> peers;
+    std::array<bool, FUZZ_PEERS> connected{};
+    for(auto& peer : peers)
+    {
+        reset_peer(peer);
+    }
+
+    {
+        MineServer server(width, height, bombs_percent, players, spectators, spectator_rate, rates);
+
+        while(!in.empty())
+        {
+            const uint8_t op = in.byte();
+            const size_t p = (op >> 2) % FUZZ_PEERS;
+            ENetEvent event{};
+            event.peer = &peers[p];
+
+            switch (op & 3)
+            {
+            case 0:
+                if(connected[p]) break;
+                connected[p] = true;
+                event.type = ENET_EVENT_TYPE_CONNECT;
+                // mostly what a client would send, sometimes anything
+                event.data = (op & 0x80) ? in.u32() : make_connect_data(in.byte() & 1 ? CONNECT_AS_SPECTATOR : CONNECT_AS_PLAYER);
+                server.handle_event(event);
+                break;
+            case 1: {
+                if(!connected[p]) break;
+                event.type = ENET_EVENT_TYPE_RECEIVE;
+                event.channelID = in.byte() % CHANNEL_COUNT;
+                const auto bytes = in.bytes(in.u16() % (MAX_FUZZ_PACKET + 1));
+                event.packet = enet_packet_create(bytes.data(), bytes.size(), ENET_PACKET_FLAG_RELIABLE);
+                server.handle_event(event);
+                enet_packet_destroy(event.packet);
+                break;
+            }
+            case 2:
+                if(!connected[p]) break;
+                connected[p] = false;
+                event.type = ENET_EVENT_TYPE_DISCONNECT;
+                server.handle_event(event);
+                reset_peer(peers[p]);
+                break;
+            case 3:
+                // like the server thread, ticks only once everyone's in
+                if(server.is_all_set)
+                {
+                    server.update(server.current_tick_time());
+                    server.send_update();
+                }
+                break;
+            }
+            fake_enet_release_sent();
+        }
+    }
+    fake_enet_release_sent();
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include "bitpack.h"
+
+#include <algorithm>
+#include <cmath>
+
+BitWriter::BitWriter(unsigned char* out, size_t capacity)
+:
+data(out), capacity_bits(capacity * 8), bit_pos(0), overflowed(false)
+{
+
+}
+
+void BitWriter::write(uint32_t value, unsigned bits)
+{
+    if(bit_pos + bits > capacity_bits)
+    {
+        overflowed = true;
+        return;
+    }
+
+    while(bits)
+    {
+        const size_t byte = bit_pos / 8;
+        const unsigned used = bit_pos % 8;
+        const unsigned take = std::min(bits, 8u - used);
+        const uint32_t chunk = (value >> (bits - take)) & ((1u << take) - 1);
+        if(used == 0) data[byte] = 0;
+        data[byte] |= chunk << (8 - used - take);
+        bit_pos += take;
+        bits -= take;
+    }
+}
+
+size_t BitWriter::finish()
+{
+    bit_pos = (bit_pos + 7) & ~size_t(7);
+    return bit_pos / 8;
+}
+
+bool BitWriter::ok() const
+{
+    return !overflowed;
+}
+
+BitReader::BitReader(const unsigned char* in, size_t length)
+:
+data(in), length_bits(length * 8), bit_pos(0), overflowed(false)
+{
+
+}
+
+uint32_t BitReader::read(unsigned bits)
+{
+    if(bit_pos + bits > length_bits)
+    {
+        overflowed = true;
+        return 0;
+    }
+
+    uint32_t value = 0;
+    while(bits)
+    {
+        const size_t byte = bit_pos / 8;
+        const unsigned used = bit_pos % 8;
+        const unsigned take = std::min(bits, 8u - used);
+        const uint32_t chunk = (data[byte] >> (8 - used - take)) & ((1u << take) - 1);
+        value = (value << take) | chunk;
+        bit_pos += take;
+        bits -= take;
+    }
+    return value;
+}
+
+size_t BitReader::finish()
+{
+    bit_pos = std::min((bit_pos + 7) & ~size_t(7), length_bits);
+    return bit_pos / 8;
+}
+
+bool BitReader::ok() const
+{
+    return !overflowed;
+}
+
+uint32_t quantize(float value, float min, float max, unsigned bits)
+{
+    const uint32_t steps = (bits >= 32 ? 0xFFFFFFFFu : (1u << bits) - 1);
+    const float t = (value - min) / (max - min);
+    if(!(t > 0.0f)) return 0;
+    if(t >= 1.0f) return steps;
+    return uint32_t(std::lround(t * steps));
+}
+
+float dequantize(uint32_t value, float min, float max, unsigned bits)
+{
+    const uint32_t steps = (bits >= 32 ? 0xFFFFFFFFu : (1u << bits) - 1);
+    return min + (max - min) * (float(value) / steps);
+}
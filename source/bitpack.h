@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// packs values of any width up to 32 bits one after the other, most significant bit first
+struct BitWriter {
+    BitWriter(unsigned char* out, size_t capacity);
+
+    void write(uint32_t value, unsigned bits);
+    // pads to the next byte, returns the bytes written so far
+    size_t finish();
+    // false if something didn't fit
+    bool ok() const;
+
+private:
+    unsigned char* data;
+    size_t capacity_bits;
+    size_t bit_pos;
+    bool overflowed;
+};
+
+struct BitReader {
+    BitReader(const unsigned char* in, size_t length);
+
+    uint32_t read(unsigned bits);
+    // skips to the next byte, returns the bytes read so far
+    size_t finish();
+    // false if a read went past the end, reads then return 0
+    bool ok() const;
+
+private:
+    const unsigned char* data;
+    size_t length_bits;
+    size_t bit_pos;
+    bool overflowed;
+};
+
+// maps [min, max] onto the 2^bits steps of an unsigned integer, clamping outside values
+uint32_t quantize(float value, float min, float max, unsigned bits);
+float dequantize(uint32_t value, float min, float max, unsigned bits);
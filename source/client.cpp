@@ -1,10 +1,8 @@
 #include "client.h"
 #include "fillers.h"
 #include "focus.h"
-
-#define LODEPNG_NO_COMPILE_ENCODER
-#define LODEPNG_NO_COMPILE_DISK
-#include "lodepng.h"
+#include "game_limits.h"
+#include "text.h"
 
 #include <cmath>
 #include <cstring>
@@ -17,13 +15,11 @@ namespace {
     constexpr float Overlay_TL_x = -1.0f;
     constexpr float Overlay_TL_y = 1.0f;
     constexpr float MyEpsilon = 0.00006103515625f;
-    using UVArr = std::tuple<float, float, float, float>;
     inline const PDD2 plain_color_uv{
         {0.0f, 1.0f},
         {0.0625f, 0.0f},
         {0.0f, 0.125f},
     };
-    inline constexpr UVArr transparent_uvs{0.25f, 0.25f, 0.125f, 0.25f};
 
     inline const glm::vec4 solidWhite{1.0f, 1.0f, 1.0f, 1.0f};
     inline const glm::vec4 solidBlack{0.0f, 0.0f, 0.0f, 1.0f};
@@ -31,127 +27,150 @@ namespace {
     inline const glm::vec3 outerScaleVec{1.125f, 1.125f, 1.125f};
     inline std::string typed_str;
     inline constexpr size_t MAX_CHAT_LINES = 8;
-
-    void character_callback(GLFWwindow* window, unsigned int codepoint)
-    {
-        bool lc = (codepoint >= 'a' && codepoint <= 'z');
-        bool uc = (codepoint >= 'A' && codepoint <= 'Z');
-        bool di = (codepoint >= '0' && codepoint <= '9');
-        bool sp = codepoint == ' ';
-        if(lc || uc || di || sp)
+    inline constexpr float FAR_PLANE = 100.0f;
+    // names further away can't be read anyway
+    inline constexpr float NAME_DRAW_DISTANCE = 32.0f;
+    // the minimap's copy of the board, at most this many texels across and this many per tile
+    inline constexpr int MINIMAP_BOARD_MAX_SIZE = 2048;
+    inline constexpr int MINIMAP_BOARD_MAX_TILE_SIZE = 32;
+
+    // the view frustum's planes, normals pointing inside, taken from a projection * view matrix
+    struct Frustum {
+        glm::vec4 planes[6];
+
+        explicit Frustum(const glm::mat4& m)
         {
-            if(typed_str.size() < MAX_CHAT_LINE_LEN_TXT)
+            const glm::mat4 rows = glm::transpose(m);
+            for(int i = 0; i < 3; ++i)
             {
-                typed_str += char(codepoint);
+                planes[i * 2] = rows[3] + rows[i];
+                planes[i * 2 + 1] = rows[3] - rows[i];
             }
         }
-    }
-
-    template<size_t N>
-    constexpr std::array<UVArr, N> generate_char_uvs(const std::array<std::pair<int, int>, N>& coords)
-    {
-        std::array<UVArr, N> out;
 
-        constexpr float delta_u = 0.0625f;
-        constexpr float delta_v = 0.125f;
-        constexpr float extra_u = 8.0f / 1024.0f;
-        constexpr float extra_v = 8.0f / 512.0f;
-
-        for(size_t i = 0; i < N; ++i)
+        bool sees_box(const glm::vec3& lo, const glm::vec3& hi) const
         {
-            auto& num = out[i];
-            const auto [col, row] = coords[i];
-            auto l_u = 0.5f + delta_u * col;
-            auto b_v = delta_v * row;
-            const auto r_u = l_u + delta_u - extra_u;
-            const auto t_v = b_v + delta_v - extra_v;
-            l_u += extra_u;
-            b_v += extra_v;
-
-            std::get<0>(num) = l_u;
-            std::get<1>(num) = t_v;
-            std::get<2>(num) = r_u - l_u;
-            std::get<3>(num) = t_v - b_v;
+            for(const auto& p : planes)
+            {
+                // the corner furthest along the normal, if even that one is outside the box is
+                const glm::vec3 corner{p.x > 0 ? hi.x : lo.x, p.y > 0 ? hi.y : lo.y, p.z > 0 ? hi.z : lo.z};
+                if(glm::dot(glm::vec3(p), corner) + p.w < 0) return false;
+            }
+            return true;
         }
-
-        return out;
-    }
-
-    template<size_t N>
-    constexpr std::array<std::pair<int, int>, N> generate_char_pos(const int start_x, const int start_y)
-    {
-        int cur_x = start_x;
-        int cur_y = start_y;
-        std::array<std::pair<int, int>, N> pos;
-        for(auto& [x, y] : pos)
+        bool sees_sphere(const glm::vec3& center, const float radius) const
         {
-            x = cur_x;
-            y = cur_y;
-            cur_x++;
-            if(cur_x == 8)
+            for(const auto& p : planes)
             {
-                cur_y--;
-                cur_x = 0;
+                const glm::vec3 normal(p);
+                if(glm::dot(normal, center) + p.w < -radius * glm::length(normal)) return false;
             }
+            return true;
         }
-        return pos;
-    }
+    };
 
-    constexpr std::array<UVArr, 10> generate_number_uvs()
+    // the board's layers are filled flat at y = 0 and each lifted into place by its model matrix,
+    // the gaps between them being too small for the half float vertex positions
+    enum class BoardLayer {
+        Floor,
+        Tiles,
+        Cursor,
+    };
+    glm::mat4 board_layer_model(const BoardLayer layer)
     {
-        return generate_char_uvs<10>(generate_char_pos<10>(4, 1));
+        return glm::translate(glm::mat4(1.0f), glm::vec3{0.0f, -1.0f + int(layer) * MyEpsilon, 0.0f});
     }
-    constexpr std::array<UVArr, 26> generate_lowerc_uvs()
+
+    inline constexpr size_t MAX_SKIN_UPLOADS_PER_FRAME = 2;
+
+    unsigned skin_worker_count()
     {
-        return generate_char_uvs<26>(generate_char_pos<26>(0, 7));
+        return std::clamp(std::thread::hardware_concurrency(), 2u, 3u) - 1;
     }
-    constexpr std::array<UVArr, 26> generate_upperc_uvs()
+
+    std::string skin_cache_path(const std::string& dir, const SkinHash& hash)
     {
-        return generate_char_uvs<26>(generate_char_pos<26>(2, 4));
+        return dir + "/" + skin_hash_to_string(hash) + ".png";
     }
 
-    inline constexpr auto number_uvs_arr = generate_number_uvs();
-    inline constexpr auto underscore_uvs_arr = generate_char_uvs<1>({{
-        {6, 0},
-    }});
-    inline constexpr auto colon_uvs_arr = generate_char_uvs<1>({{
-        {7, 0},
-    }});
-    inline constexpr std::array<UVArr, 1> transparent_uvs_arr{{transparent_uvs}};
-
-    inline constexpr auto lowerc_uvs_arr = generate_lowerc_uvs();
-    inline constexpr auto upperc_uvs_arr = generate_upperc_uvs();
+    // only accepts the file if it still matches its name
+    bool read_cached_skin(const std::string& dir, const SkinHash& hash, std::vector<unsigned char>& out)
+    {
+        FILE* fh = fopen(skin_cache_path(dir, hash).c_str(), "rb");
+        if(!fh) return false;
+        fseek(fh, 0, SEEK_END);
+        const long bytes_sz = ftell(fh);
+        rewind(fh);
+        bool ok = bytes_sz > 0 && size_t(bytes_sz) <= MAX_SKIN_BYTES;
+        if(ok)
+        {
+            out.resize(bytes_sz);
+            ok = fread(out.data(), 1, bytes_sz, fh) == size_t(bytes_sz);
+        }
+        fclose(fh);
+        return ok && hash_skin(out.data(), out.size()) == hash;
+    }
 
-    void fill_minimap(VertexPtr verts)
+    void write_cached_skin(const std::string& dir, const SkinHash& hash, const unsigned char* data, size_t size)
     {
-        Fillers::fill_quad_generic(verts, 0,
-            PDD3{
-                {0.0f, 0.0f, 0.0f},
-                {1, 0, 0},
-                {0.0f, 128.0f/384.0f, 0.0f}
-            },
-            PDD2{
-                {0.0f, 1.0f},
-                {1.0f, 0.0f},
-                {0.0f, 1.0f},
-            },
-        solidWhite);
+        const auto path = skin_cache_path(dir, hash);
+        if(FILE* fh = fopen(path.c_str(), "rb"); fh)
+        {
+            fclose(fh);
+            return;
+        }
+        if(FILE* fh = fopen(path.c_str(), "wb"); fh)
+        {
+            fwrite(data, 1, size, fh);
+            fclose(fh);
+        }
     }
-    void fill_chat_visible(VertexPtr verts)
+
+    void character_callback(GLFWwindow* window, unsigned int codepoint)
     {
-        Fillers::fill_quad_generic(verts, 0,
-            PDD3{
-                {0.0f, 0.0f, 0.0f},
-                {1, 0, 0},
-                {0, 1, 0}
-            },
-            PDD2{
-                {0.0f, 1.0f},
-                {1.0f, 0.0f},
-                {0.0f, 1.0f},
-            },
-        solidWhite);
+        bool lc = (codepoint >= 'a' && codepoint <= 'z');
+        bool uc = (codepoint >= 'A' && codepoint <= 'Z');
+        bool di = (codepoint >= '0' && codepoint <= '9');
+        bool sp = codepoint == ' ';
+        if(lc || uc || di || sp)
+        {
+            if(typed_str.size() < MAX_CHAT_LINE_LEN_TXT)
+            {
+                typed_str += char(codepoint);
+            }
+        }
     }
+    // the HUD's sprites, put in place by their model as they're added to the batch
+    inline const PDD3 hud_unit_quad{
+        {0.0f, 0.0f, 0.0f},
+        {1, 0, 0},
+        {0, 1, 0}
+    };
+    inline const PDD3 hud_minimap_quad{
+        {0.0f, 0.0f, 0.0f},
+        {1, 0, 0},
+        {0.0f, 128.0f/384.0f, 0.0f}
+    };
+    inline const PDD3 hud_crosshair_quad{
+        {-0.5f, 0.5f, 0.0f},
+        {1, 0, 0},
+        {0, 1, 0}
+    };
+    inline const PDD2 whole_texture_uv{
+        {0.0f, 1.0f},
+        {1.0f, 0.0f},
+        {0.0f, 1.0f},
+    };
+    inline const PDD2 overlay_uv{
+        {0.0f, 0.75f},
+        {0.125f, 0.0f},
+        {0.0f, 0.75f},
+    };
+    // chat, minimap, overlay, the counters' cells then four crosshair lines
+    inline constexpr size_t HUD_COUNTERS_FIRST = 3;
+    inline constexpr size_t HUD_COUNTER_QUADS = 5 + 4 + 4;
+    inline constexpr size_t HUD_QUADS = HUD_COUNTERS_FIRST + HUD_COUNTER_QUADS + 4;
+
     void fill_minimap_behind(VertexPtr verts)
     {
         Fillers::fill_quad_generic(verts, 0, 
@@ -168,27 +187,11 @@ namespace {
             solidWhite
         );
     }
-    void fill_overlay(VertexPtr verts)
-    {
-        Fillers::fill_quad_generic(verts, 0, 
-            PDD3{
-                {0.0f, 0.0f, 0.0f},
-                {1, 0, 0},
-                {0, 1, 0}
-            },
-            PDD2{
-                {0.0f, 0.75f},
-                {0.125f, 0.0f},
-                {0.0f, 0.75f},
-            },
-            solidWhite
-        );
-    }
     void fill_cursor(VertexPtr verts)
     {
         Fillers::fill_quad_generic(verts, 0,
             PDD3{
-                {0.0f, -1.0f + MyEpsilon * 2.0f, 0.0f},
+                {0.0f, 0.0f, 0.0f},
                 {1, 0, 0},
                 {0.0f, 0.0f, 1.0f},
             },
@@ -200,19 +203,6 @@ namespace {
         solidWhite);
     }
 
-    void fill_crosshair(VertexPtr verts)
-    {
-        Fillers::fill_quad_generic(verts, 0, 
-            PDD3{
-                {-0.5f, 0.5f, 0.0f},
-                {1, 0, 0},
-                {0, 1, 0}
-            },
-            plain_color_uv,
-            solidWhite
-        );
-    }
-
     void fill_walls(VertexPtr verts, const int width, const int height)
     {
         const float maxX = width;
@@ -270,8 +260,29 @@ namespace {
         }
     }
 
-    void fill_player_part(VertexPtr verts, float u_l_all, float v_t_all, float h, float wz, float wx)
+    // the whole board as one quad, texture coordinates going 0 to 1 across it
+    // for the shader to find the tile in the board state texture
+    void fill_board_floor(VertexPtr verts, const int width, const int height)
+    {
+        Fillers::fill_quad_generic(verts, 0,
+            PDD3{
+                {0.0f, 0.0f, float(height)},
+                {float(width), 0.0f, 0.0f},
+                {0.0f, 0.0f, float(height)}
+            },
+            PDD2{
+                {0.0f, 1.0f},
+                {1.0f, 0.0f},
+                {0.0f, 1.0f}
+            },
+            solidWhite
+        );
+    }
+
+    // a unit cube as the 6 quads of one avatar part
+    void fill_player_part(VertexPtr& verts, const size_t part, float u_l_all, float v_t_all, float h, float wz, float wx)
     {
+        const size_t first = part * 6;
         const float center_u = u_l_all + (wz + wx);
         PDD2 pz_uv{
             {u_l_all + wx, v_t_all - wx},
@@ -306,21 +317,21 @@ namespace {
             {0.0f, wx},
         };
 
-        Fillers::fill_quad_generic(verts, 0, // +Z
+        Fillers::fill_quad_generic(verts, first + 0, // +Z
             PDD3{
                 {+0.5f, +0.5f, +0.5f},
                 {-1.0f, 0.0f, 0.0f},
                 {0.0f, +1.0f, 0.0f}
             },
         mz_uv, solidWhite);
-        Fillers::fill_quad_generic(verts, 1, // -X
+        Fillers::fill_quad_generic(verts, first + 1, // -X
             PDD3{
                 {-0.5f, +0.5f, +0.5f},
                 {0.0f, 0.0f, -1.0f},
                 {0.0f, +1.0f, 0.0f}
             },
         mx_uv, solidWhite);
-        Fillers::fill_quad_generic(verts, 2, // +Y
+        Fillers::fill_quad_generic(verts, first + 2, // +Y
             PDD3{
                 {-0.5f, +0.5f, +0.5f},
                 {+1, 0, 0},
@@ -328,21 +339,21 @@ namespace {
             },
         py_uv, solidWhite);
 
-        Fillers::fill_quad_generic(verts, 3, // -Z
+        Fillers::fill_quad_generic(verts, first + 3, // -Z
             PDD3{
                 {-0.5f,+0.5f,-0.5f},
                 {+1.0f,0.0f,0.0f},
                 {0.0f,+1.0f,0.0f}
             },
         pz_uv, solidWhite);
-        Fillers::fill_quad_generic(verts, 4, // +X
+        Fillers::fill_quad_generic(verts, first + 4, // +X
             PDD3{
                 {+0.5f, +0.5f, -0.5f},
                 {0.0f,0.0f,+1.0f},
                 {0.0f,+1.0f,0.0f}
             },
         px_uv, solidWhite);
-        Fillers::fill_quad_generic(verts, 5, // -Y
+        Fillers::fill_quad_generic(verts, first + 5, // -Y
             PDD3{
                 {+0.5f, -0.5f, -0.5f},
                 {0.0f,0.0f,+1.0f},
@@ -350,30 +361,25 @@ namespace {
             },
         my_uv, solidWhite);
     }
-    void fill_player(Buffer& head_buf, Buffer& body_buf, Buffer& arm_l_buf, Buffer& arm_r_buf, Buffer& leg_l_buf, Buffer& leg_r_buf)
+    // parts in the order the avatar shader expects them, the outer layer after the rest
+    void fill_avatar(VertexPtr verts)
     {
-        fill_player_part(head_buf.getAllVerts(), 0.0f, 1.0f, 1.0f/8.0f, 1.0f/8.0f, 1.0f/8.0f);
-        fill_player_part(body_buf.getAllVerts(), 0.25f, 0.75f, 3.0f/16.0f, 2.0f/16.0f, 1.0f/16.0f);
-
-        fill_player_part(arm_l_buf.getAllVerts(), 0.5f, 0.25f, 3.0f/16.0f, 1.0f/16.0f, 1.0f/16.0f);
-        fill_player_part(arm_r_buf.getAllVerts(), 0.625f, 0.75f, 3.0f/16.0f, 1.0f/16.0f, 1.0f/16.0f);
-        
-        fill_player_part(leg_l_buf.getAllVerts(), 0.25f, 0.25f, 3.0f/16.0f, 1.0f/16.0f, 1.0f/16.0f);
-        fill_player_part(leg_r_buf.getAllVerts(), 0.0f, 0.75f, 3.0f/16.0f, 1.0f/16.0f, 1.0f/16.0f);
+        fill_player_part(verts, 0, 0.25f, 0.75f, 3.0f/16.0f, 2.0f/16.0f, 1.0f/16.0f);
+        fill_player_part(verts, 1, 0.5f, 0.25f, 3.0f/16.0f, 1.0f/16.0f, 1.0f/16.0f);
+        fill_player_part(verts, 2, 0.625f, 0.75f, 3.0f/16.0f, 1.0f/16.0f, 1.0f/16.0f);
+        fill_player_part(verts, 3, 0.25f, 0.25f, 3.0f/16.0f, 1.0f/16.0f, 1.0f/16.0f);
+        fill_player_part(verts, 4, 0.0f, 0.75f, 3.0f/16.0f, 1.0f/16.0f, 1.0f/16.0f);
+        fill_player_part(verts, 5, 0.0f, 1.0f, 1.0f/8.0f, 1.0f/8.0f, 1.0f/8.0f);
+
+        fill_player_part(verts, 6, 0.25f, 0.5f, 3.0f/16.0f, 2.0f/16.0f, 1.0f/16.0f);
+        fill_player_part(verts, 7, 0.75f, 0.25f, 3.0f/16.0f, 1.0f/16.0f, 1.0f/16.0f);
+        fill_player_part(verts, 8, 0.625f, 0.5f, 3.0f/16.0f, 1.0f/16.0f, 1.0f/16.0f);
+        fill_player_part(verts, 9, 0.0f, 0.25f, 3.0f/16.0f, 1.0f/16.0f, 1.0f/16.0f);
+        fill_player_part(verts, 10, 0.0f, 0.5f, 3.0f/16.0f, 1.0f/16.0f, 1.0f/16.0f);
+        fill_player_part(verts, 11, 0.5f, 1.0f, 1.0f/8.0f, 1.0f/8.0f, 1.0f/8.0f);
     }
-    void fill_player_extra(Buffer& head_buf, Buffer& body_buf, Buffer& arm_l_buf, Buffer& arm_r_buf, Buffer& leg_l_buf, Buffer& leg_r_buf)
-    {
-        fill_player_part(head_buf.getAllVerts(), 0.5f, 1.0f, 1.0f/8.0f, 1.0f/8.0f, 1.0f/8.0f);
-        fill_player_part(body_buf.getAllVerts(), 0.25f, 0.5f, 3.0f/16.0f, 2.0f/16.0f, 1.0f/16.0f);
 
-        fill_player_part(arm_l_buf.getAllVerts(), 0.75f, 0.25f, 3.0f/16.0f, 1.0f/16.0f, 1.0f/16.0f);
-        fill_player_part(arm_r_buf.getAllVerts(), 0.625f, 0.5f, 3.0f/16.0f, 1.0f/16.0f, 1.0f/16.0f);
-        
-        fill_player_part(leg_l_buf.getAllVerts(), 0.0f, 0.25f, 3.0f/16.0f, 1.0f/16.0f, 1.0f/16.0f);
-        fill_player_part(leg_r_buf.getAllVerts(), 0.0f, 0.5f, 3.0f/16.0f, 1.0f/16.0f, 1.0f/16.0f);
-    }
-
-    void fill_name(VertexPtr verts, std::string_view name)
+    void fill_name(Buffer& buf, std::string_view name)
     {
         constexpr float start_y = 1.25f - 0.0625f;
         constexpr float height = 0.675f/4.0f;
@@ -381,123 +387,39 @@ namespace {
         const float width = name.size() * delta_x;
         const float start_x = (width / 2.0f);
 
-        Fillers::fill_quad_generic(verts, 0, 
-            PDD3{
-                {start_x - width, start_y, 0.0f},
-                {width, 0.0f, 0.0f},
-                {0.0f, height, 0.0f}
-            },
-            plain_color_uv, slightlyBlack);
-
-        size_t idx = 1;
-        float x = start_x;
-
-        auto write_char = [&](const int c, const auto& arr) {
-            const auto [l_u, t_v, del_u, del_v] = arr[c];
-            Fillers::fill_quad_generic(verts, idx, 
+        {
+            auto verts = buf.getQuads(0, 1);
+            Fillers::fill_quad_generic(verts, 0, 
                 PDD3{
-                    {x, start_y, -MyEpsilon},
-                    {delta_x, 0.0f, 0.0f},
+                    {start_x - width, start_y, 0.0f},
+                    {width, 0.0f, 0.0f},
                     {0.0f, height, 0.0f}
                 },
-                PDD2{
-                    {l_u + del_u, t_v},
-                    {-del_u, 0.0f},
-                    {0.0f, del_v}
-                },
-            solidWhite);
-        };
-
-        for(char c : name)
-        {
-            x -= delta_x;
-            if(c == '_')
-            {
-                write_char(0, underscore_uvs_arr);
-            }
-            else if(c == ' ')
-            {
-                write_char(0, transparent_uvs_arr);
-            }
-            else if(c >= '0' && c <= '9')
-            {
-                write_char(c - '0', number_uvs_arr);
-            }
-            else if(c >= 'a' && c <= 'z')
-            {
-                write_char(c - 'a', lowerc_uvs_arr);
-            }
-            else if(c >= 'A' && c <= 'Z')
-            {
-                write_char(c - 'A', upperc_uvs_arr);
-            }
-            idx += 1;
+                plain_color_uv, slightlyBlack);
         }
+
+        // the front of the tag faces away from its player, cells past the name are left empty
+        TextRun(1, MAX_NAME_LEN, TextRun::Layout{{start_x, start_y, -MyEpsilon}, {delta_x, height}, true}).set(buf, name, solidWhite);
     }
-    void fill_counters(VertexPtr verts, const ServerWorldPacket& info, const int bombs, const bool first_time)
+    // row 0 is the timer, then bombs and flags, first_cell counts from the timer's first digit.
+    // overlay puts the overlay on screen, it only translates and scales
+    TextRun::Layout counter_layout(const int row, const int first_cell, const glm::mat4& overlay)
     {
         constexpr float timer_y = 128.0f / 384.0f;
         constexpr float delta_y = 50.0f / 384.0f;
         constexpr float start_x = 44.0f / 128.0f;
         constexpr float delta_x = 15.0f / 128.0f;
-
         constexpr float height = 32.0f / 384.0f;
-        constexpr float bombs_y = timer_y + delta_y;
-        constexpr float flags_y = bombs_y + delta_y;
 
-        auto write_char = [&](size_t idx, const int* arr_indices, const auto arr_uvs, const int* arr_xs, const size_t cnt, const float y) {
-            for(size_t i = 0; i < cnt; ++i)
-            {
-                const auto [l_u, t_v, del_u, del_v] = arr_uvs[arr_indices[i]];
-                const auto x = arr_xs[i] * delta_x;
-                Fillers::fill_quad_generic(verts, idx, 
-                    PDD3{
-                        {start_x + x, -(y + ((delta_y - height)/4.0f)), -MyEpsilon},
-                        {delta_x, 0.0f, 0.0f},
-                        {0.0f, height, 0.0f}
-                    },
-                    PDD2{
-                        {l_u, t_v},
-                        {del_u, 0.0f},
-                        {0.0f, del_v}
-                    },
-                solidBlack);
-                idx += 1;
-            }
-        };
-
-        if(first_time)
-        {
-            {
-                int arr_indices[] = {0};
-                int arr_xs[] = {2};
-                write_char(0, arr_indices, colon_uvs_arr, arr_xs, 1, timer_y);
-            }
-            {
-                const auto thousands = div(bombs, 1000);
-                const auto hundreds = div(thousands.rem, 100);
-                const auto tens = div(hundreds.rem, 10);
-                int arr_indices[] = {thousands.quot, hundreds.quot, tens.quot, tens.rem};
-                int arr_xs[] = {1, 2, 3 ,4};
-                write_char(1, arr_indices, number_uvs_arr, arr_xs, 4, bombs_y);
-            }
-        }
-
-        {
-            const auto thousands = div(ENET_NET_TO_HOST_16(info.placed_flags), 1000);
-            const auto hundreds = div(thousands.rem, 100);
-            const auto tens = div(hundreds.rem, 10);
-            int arr_indices[] = {thousands.quot, hundreds.quot, tens.quot, tens.rem};
-            int arr_xs[] = {1, 2, 3, 4};
-            write_char(5, arr_indices, number_uvs_arr, arr_xs, 4, flags_y);
-        }
-        {
-            const auto mins_tens = div(info.minutes, 10);
-            const auto secs_tens = div(info.seconds, 10);
-            int arr_indices[] = {mins_tens.quot % 10, mins_tens.rem, secs_tens.quot, secs_tens.rem};
-            int arr_xs[] = {0, 1, 3, 4};
-            write_char(9, arr_indices, number_uvs_arr, arr_xs, 4, timer_y);
-        }
+        const float y = timer_y + row * delta_y;
+        const glm::vec4 origin{start_x + first_cell * delta_x, -(y + ((delta_y - height)/4.0f)), -MyEpsilon, 1.0f};
+        return TextRun::Layout{glm::vec3(overlay * origin), {delta_x * overlay[0][0], height * overlay[1][1]}, false};
+    }
+    std::string four_digits(const unsigned value)
+    {
+        char out[8];
+        snprintf(out, sizeof(out), "%04u", value % 10000);
+        return out;
     }
     void fill_indicator(VertexPtr verts)
     {
@@ -516,224 +438,59 @@ namespace {
         );
     }
     
-    void fill_chat(VertexPtr verts, const std::vector<std::unique_ptr<char[]>>& lines, const std::vector<PlayerData>& players)
-    {
-        constexpr float start_y = 1.0f;
-        constexpr float height = 2.0f/(MAX_CHAT_LINES + 2);
-        const float delta_x = 2.0f/MAX_CHAT_LINE_LEN;
-        const float start_x = -1.0f;
-
-        size_t idx = MAX_CHAT_LINE_LEN;
-        float x = start_x;
-        float y = start_y;
-
-        auto write_char = [&](const int c, const auto& arr, const auto& col) {
-            const auto [l_u, t_v, del_u, del_v] = arr[c];
-            Fillers::fill_quad_generic(verts, idx, 
-                PDD3{
-                    {x, y, -MyEpsilon},
-                    {delta_x, 0.0f, 0.0f},
-                    {0.0f, height, 0.0f}
-                },
-                PDD2{
-                    {l_u, t_v},
-                    {del_u, 0.0f},
-                    {0.0f, del_v}
-                },
-            col);
-        };
-
-        for(size_t i = MAX_CHAT_LINE_LEN, j = 0; i < verts.count / 6; ++i)
-        {
-            write_char(0, transparent_uvs_arr, solidWhite);
-            idx += 1;
-
-            j++;
-            if(j == MAX_CHAT_LINE_LEN)
-            {
-                x = start_x;
-                y -= height;
-                j = 0;
-            }
-            else
-            {
-                x += delta_x;
-            }
-        }
-        
-        x = start_x;
-        y = start_y;
-        idx = MAX_CHAT_LINE_LEN;
-        for(auto& ln : lines)
-        {
-            const char usernum = ln[0];
-            const auto col = players[usernum].color;
-            for(size_t i = 0; i < MAX_NAME_LEN; ++i)
-            {
-                const auto c = players[usernum].username[i];
-                if(c == '_')
-                {
-                    write_char(0, underscore_uvs_arr, col);
-                }
-                else if(c == ' ')
-                {
-                    write_char(0, transparent_uvs_arr, col);
-                }
-                else if(c >= '0' && c <= '9')
-                {
-                    write_char(c - '0', number_uvs_arr, col);
-                }
-                else if(c >= 'a' && c <= 'z')
-                {
-                    write_char(c - 'a', lowerc_uvs_arr, col);
-                }
-                else if(c >= 'A' && c <= 'Z')
-                {
-                    write_char(c - 'A', upperc_uvs_arr, col);
-                }
-                x += delta_x;
-                idx += 1;
-            }
-            
-            x = start_x;
-            y -= height;
-            for(size_t i = 1; i <= MAX_CHAT_LINE_LEN_TXT; ++i)
-            {
-                const auto c = ln[i];
-                if(c == ' ')
-                {
-                    write_char(0, transparent_uvs_arr, solidWhite);
-                }
-                else if(c >= '0' && c <= '9')
-                {
-                    write_char(c - '0', number_uvs_arr, solidWhite);
-                }
-                else if(c >= 'a' && c <= 'z')
-                {
-                    write_char(c - 'a', lowerc_uvs_arr, solidWhite);
-                }
-                else if(c >= 'A' && c <= 'Z')
-                {
-                    write_char(c - 'A', upperc_uvs_arr, solidWhite);
-                }
-                x += delta_x;
-                idx += 1;
-            }
-
-            x = start_x;
-            y -= height;
-        }
-
-    }
-
-    void fill_typed(VertexPtr verts)
+    // chat_buf holds the typed line, then MAX_CHAT_LINES rows from the top down
+    inline constexpr float CHAT_ROW_HEIGHT = 2.0f/(MAX_CHAT_LINES + 2);
+    TextRun::Layout chat_row_layout(const float y)
     {
-        constexpr float height = 2.0f/(MAX_CHAT_LINES + 2);
-        const float delta_x = 2.0f/MAX_CHAT_LINE_LEN;
-        const float start_x = -1.0f;
-
-        size_t idx = 0;
-        float x = start_x;
-        const float y = -1.0f + height * 2.0f;
-
-        auto write_char = [&](const int c, const auto& arr, const auto& col) {
-            const auto [l_u, t_v, del_u, del_v] = arr[c];
-            Fillers::fill_quad_generic(verts, idx, 
-                PDD3{
-                    {x, y, -MyEpsilon},
-                    {delta_x, 0.0f, 0.0f},
-                    {0.0f, height, 0.0f}
-                },
-                PDD2{
-                    {l_u, t_v},
-                    {del_u, 0.0f},
-                    {0.0f, del_v}
-                },
-            col);
-        };
-
-        for(size_t i = 0; i < MAX_CHAT_LINE_LEN; ++i)
-        {
-            write_char(0, transparent_uvs_arr, solidWhite);
-            x += delta_x;
-            idx += 1;
-        }
-
-        idx = 0;
-        x = start_x;
-        for(const auto c : typed_str)
-        {
-            if(c == ' ')
-            {
-                write_char(0, transparent_uvs_arr, solidWhite);
-            }
-            else if(c >= '0' && c <= '9')
-            {
-                write_char(c - '0', number_uvs_arr, solidWhite);
-            }
-            else if(c >= 'a' && c <= 'z')
-            {
-                write_char(c - 'a', lowerc_uvs_arr, solidWhite);
-            }
-            else if(c >= 'A' && c <= 'Z')
-            {
-                write_char(c - 'A', upperc_uvs_arr, solidWhite);
-            }
-            x += delta_x;
-            idx += 1;
-        }
+        return TextRun::Layout{{-1.0f, y, -MyEpsilon}, {2.0f/MAX_CHAT_LINE_LEN, CHAT_ROW_HEIGHT}, false};
     }
 }
 
-MineClient::MineClient(const char * server_addr, const char* skinpath, Texture& default_skin, const std::array<float, 4>& c_c, const char* un)
+MineClient::MineClient(const char * server_addr, const char* skinpath, const std::vector<unsigned char>& default_skin, const std::array<float, 4>& c_c, const char* un, bool spectate, const std::string& skin_cache)
 :
-host(enet_host_create(nullptr, 1, 2, 0, 0)),
-default_skin_tex(default_skin),
+default_skin_pixels(default_skin),
 minimap_frame(256, 256),
 chat_frame(MAX_CHAT_LINE_LEN * 32, (MAX_CHAT_LINES + 1) * 32),
+camera_buf(sizeof(CameraBlock), CAMERA_BLOCK_BINDING),
 minimap_behind_buf(Buffer::Quads(1)),
 indicator_buf(Buffer::Quads(1)),
 chat_buf(Buffer::Quads((MAX_CHAT_LINE_LEN * MAX_CHAT_LINES) + MAX_CHAT_LINE_LEN)),
-chat_visible_buf(Buffer::Quads(1)),
-minimap_buf(Buffer::Quads(1)),
-overlay_buf(Buffer::Quads(1)),
-crosshair_buf(Buffer::Quads(1)),
-counters_buf(Buffer::Quads(5 + 4 + 4)),
 cursor_buf(Buffer::Quads(1)),
-player_head_buf(Buffer::Quads(6)),
-player_body_buf(Buffer::Quads(6)),
-player_arm_left_buf(Buffer::Quads(6)),
-player_arm_right_buf(Buffer::Quads(6)),
-player_leg_left_buf(Buffer::Quads(6)),
-player_leg_right_buf(Buffer::Quads(6)),
-player_helm_buf(Buffer::Quads(6)),
-player_coat_buf(Buffer::Quads(6)),
-player_sleeve_left_buf(Buffer::Quads(6)),
-player_sleeve_right_buf(Buffer::Quads(6)),
-player_pant_left_buf(Buffer::Quads(6)),
-player_pant_right_buf(Buffer::Quads(6)),
+avatar_buf(Buffer::Quads(12 * 6)),
+hud(HUD_QUADS),
+counters_model(0.0f),
+timer_text(HUD_COUNTERS_FIRST, 5, counter_layout(0, 0, glm::mat4(1.0f))),
+bombs_text(HUD_COUNTERS_FIRST + 5, 4, counter_layout(1, 1, glm::mat4(1.0f))),
+flags_text(HUD_COUNTERS_FIRST + 9, 4, counter_layout(2, 1, glm::mat4(1.0f))),
+typed_text(0, MAX_CHAT_LINE_LEN, chat_row_layout(-1.0f + CHAT_ROW_HEIGHT * 2.0f)),
+chat_frame_dirty(true),
 current_state(MineClient::State::NotConnected),
 pressed_m1(false),
 pressed_m2(false),
 first_mouse(true),
 send_str(false),
+spectating(spectate),
+catchup_received(0),
+skin_cache_dir(skin_cache),
+skin_decoder(skin_worker_count()),
 my_crosshair_color(c_c),
-username(un)
+username(un),
+rates(DEFAULT_RATES)
 {
-    fill_crosshair(crosshair_buf.getAllVerts());
     fill_cursor(cursor_buf.getAllVerts());
     fill_indicator(indicator_buf.getAllVerts());
-    fill_minimap(minimap_buf.getAllVerts());
     fill_minimap_behind(minimap_behind_buf.getAllVerts());
-    fill_overlay(overlay_buf.getAllVerts());
-    fill_player(player_head_buf, player_body_buf, player_arm_left_buf, player_arm_right_buf, player_leg_left_buf, player_leg_right_buf);
-    fill_player_extra(player_helm_buf, player_coat_buf, player_sleeve_left_buf, player_sleeve_right_buf, player_pant_left_buf, player_pant_right_buf);
-    fill_chat_visible(chat_visible_buf.getAllVerts());
-    fill_typed(chat_buf.getAllVerts());
+    fill_avatar(avatar_buf.getAllVerts());
+    for(size_t i = 0; i < MAX_CHAT_LINES; ++i)
+    {
+        chat_rows.emplace_back(MAX_CHAT_LINE_LEN * (i + 1), MAX_CHAT_LINE_LEN, chat_row_layout(1.0f - CHAT_ROW_HEIGHT * i));
+    }
+    fill_chat({});
+    typed_text.set(chat_buf, typed_str, solidWhite);
 
     if(skinpath == nullptr)
     {
-        skin_bytes.resize(sizeof(PlayerMetaPacket));
+        skin_bytes.resize(PlayerMetaPacket::WIRE_SIZE);
     }
     else
     {
@@ -741,11 +498,15 @@ username(un)
         fseek(fh, 0, SEEK_END);
         long bytes_sz = ftell(fh);
         rewind(fh);
-        skin_bytes.resize(bytes_sz + sizeof(PlayerMetaPacket));
-        fread(skin_bytes.data() + sizeof(PlayerMetaPacket), 1, bytes_sz, fh);
+        skin_bytes.resize(bytes_sz + PlayerMetaPacket::WIRE_SIZE);
+        fread(skin_bytes.data() + PlayerMetaPacket::WIRE_SIZE, 1, bytes_sz, fh);
         fclose(fh);
+
+        const auto own_skin = skin_bytes.data() + PlayerMetaPacket::WIRE_SIZE;
+        write_cached_skin(skin_cache_dir, hash_skin(own_skin, bytes_sz), own_skin, bytes_sz);
     }
 
+    ENetAddress address;
     if(server_addr[0] == '\0')
     {
         enet_address_set_host(&address, "127.0.0.1");
@@ -755,25 +516,69 @@ username(un)
         enet_address_set_host(&address, server_addr);
     }
     address.port = COMMS_PORT;
-    peer = enet_host_connect(host.get(), &address, 2, 0);
+    net = std::make_unique<ClientNet>(address, make_connect_data(spectating ? CONNECT_AS_SPECTATOR : CONNECT_AS_PLAYER));
 
     cs_packet.action = 0;
 }
 
-void MineClient::receive_packet(unsigned char* data, size_t length, std::vector<std::unique_ptr<char[]>>& out_chat)
+void MineClient::receive_packet(const unsigned char* data, size_t length, enet_uint8 channel, std::vector<std::unique_ptr<char[]>>& out_chat)
 {
     if(current_state == MineClient::State::NotConnected)
     {
+        if(channel != CHANNEL_CONTROL)
+        {
+            queued_packets.push_back(QueuedPacket{channel, std::vector<unsigned char>(data, data + length)});
+            return;
+        }
+
+        WireReader r(data, length);
         ServerWorldPacketInit in;
-        memcpy(&in, data, sizeof(in));
+        const bool complete = read_packet(r, in) && r.remaining() == 0;
+        if(in.protocol_version != PROTOCOL_VERSION)
+        {
+            fprintf(stderr, "Server is on protocol version %u, this client is on %u.\n", in.protocol_version, PROTOCOL_VERSION);
+            disconnect(true);
+            return;
+        }
+        // everything else is sized from these, so they have to be what a server could have been started with
+        const bool valid = in.players >= Limits::Min::Players && in.players <= Limits::Max::Players
+            && (in.your_id < in.players || in.your_id == SPECTATOR_ID)
+            && in.width >= Limits::Min::Width && in.width <= Limits::Max::Width
+            && in.height >= Limits::Min::Height && in.height <= Limits::Max::Height
+            && in.bombs <= in.width * in.height;
+        if(!complete || !valid)
+        {
+            fprintf(stderr, "Invalid init packet (%zu bytes)\n", length);
+            disconnect(true);
+            return;
+        }
 
         players.resize(in.players);
-        skins.resize(in.players);
+        player_snapshots.resize(in.players);
+        player_skins.resize(in.players);
+        // layer 0 is the default skin, then one per player
+        skin_uploaded.assign(in.players, false);
+        skin_array = std::make_unique<TextureArray>(SKIN_SIZE, SKIN_SIZE, in.players + 1);
+        skin_array->upload(0, default_skin_pixels.data());
         my_player_id = in.your_id;
 
         width = in.width;
         height = in.height;
-        total_bombs = ENET_NET_TO_HOST_16(in.bombs);
+        total_bombs = in.bombs;
+        rates = in.rates;
+        rates.tick_rate = std::clamp<int>(rates.tick_rate, Limits::Min::TickRate, Limits::Max::TickRate);
+        rates.snapshot_rate = std::clamp<int>(rates.snapshot_rate, Limits::Min::SnapshotRate, Limits::Max::SnapshotRate);
+        rates.input_rate = std::clamp<int>(rates.input_rate, Limits::Min::InputRate, Limits::Max::InputRate);
+        clock.set_rates(rates);
+
+        if(my_player_id == SPECTATOR_ID)
+        {
+            // start by following the first player, nothing to send
+            spectating = true;
+            my_player_id = 0;
+            current_state = MineClient::State::Waiting;
+            return;
+        }
 
         PlayerMetaPacket out;
         out.cross_r = 255 * my_crosshair_color[0];
@@ -781,65 +586,170 @@ void MineClient::receive_packet(unsigned char* data, size_t length, std::vector<
         out.cross_b = 255 * my_crosshair_color[2];
         out.cross_a = 255 * my_crosshair_color[3];
         memcpy(out.username, username, sizeof(out.username));
-        out.skinbytes = ENET_HOST_TO_NET_32(skin_bytes.size() - sizeof(PlayerMetaPacket));
+        out.skinbytes = skin_bytes.size() - PlayerMetaPacket::WIRE_SIZE;
 
-        memcpy(skin_bytes.data(), &out, sizeof(out));
+        WireWriter w(skin_bytes.data(), PlayerMetaPacket::WIRE_SIZE);
+        write_packet(w, out);
 
-        auto send_packet(enet_packet_create(skin_bytes.data(), skin_bytes.size(), ENET_PACKET_FLAG_RELIABLE));
-        enet_peer_send(peer, 0, send_packet);
-        enet_host_flush(host.get());
+        net->send(enet_packet_create(skin_bytes.data(), skin_bytes.size(), ENET_PACKET_FLAG_RELIABLE), CHANNEL_CONTROL);
 
         current_state = MineClient::State::Waiting;
     }
     else if(current_state == MineClient::State::Waiting)
     {
-        size_t offset = 0, player_idx = 0;
+        if(channel != CHANNEL_CONTROL || control_kind(data, length) == CONTROL_PLAYER_JOINED)
+        {
+            // these come after our catch-up state, keep them for when it's complete
+            queued_packets.push_back(QueuedPacket{channel, std::vector<unsigned char>(data, data + length)});
+            return;
+        }
+
+        WireReader r(data, length);
+        StreamChunkPacket chunk;
+        if(!read_packet(r, chunk) || r.remaining() > CATCHUP_CHUNK_SIZE) return;
+        const size_t total = chunk.total;
+        const size_t chunk_offset = chunk.offset;
+        const size_t chunk_size = r.remaining();
+        // every player's start data, then the terrain which run-length encoding at worst doubles
+        if(total > (players.size() * StartDataPacket::WIRE_SIZE) + (2 * size_t(width) * height)) return;
+        if(catchup_data.size() != total)
+        {
+            catchup_data.resize(total);
+            catchup_received = 0;
+        }
+        if(chunk_offset > total || chunk_size > total - chunk_offset) return;
+
+        memcpy(catchup_data.data() + chunk_offset, r.bytes(chunk_size), chunk_size);
+        catchup_received += chunk_size;
+        if(catchup_received < total) return;
+
+        WireReader stream(catchup_data.data(), catchup_data.size());
+        size_t player_idx = 0;
         StartDataPacket in;
-        std::vector<unsigned char> skin_pixels;
         for(auto& player : players)
         {
-            memcpy(&in, data + offset, sizeof(in));
+            if(!read_packet(stream, in))
+            {
+                fprintf(stderr, "Catch-up stream too short for %zu players\n", players.size());
+                disconnect(true);
+                return;
+            }
             player.fill(in.info);
             player.fill(in.meta);
             const char* name = in.meta.username;
             const size_t namelen = strnlen(name, MAX_NAME_LEN);
-            player_names_buf.push_back(Buffer::Quads(namelen + 1));
-            fill_name(player_names_buf.back().getAllVerts(), std::string_view{name, namelen});
-            
-            offset += sizeof(in);
-            enet_uint32 skin_sz = ENET_NET_TO_HOST_32(in.meta.skinbytes);
-            if(skin_sz)
+            // room for any name, someone else can take the slot later
+            player_names_buf.push_back(Buffer::Quads(MAX_NAME_LEN + 1));
+            fill_name(player_names_buf.back(), std::string_view{name, namelen});
+
+            player_skins[player_idx] = in.meta.skinbytes ? in.skin : SkinHash{};
+            player_idx++;
+        }
+        request_skins();
+
+        wall_buf = std::make_unique<Buffer>(Buffer::Quads((width + height) * 2));
+        fill_walls(wall_buf->getAllVerts(), width, height);
+        // fill_walls goes along z = 0 and x = 0, then along z = height and x = width
+        wall_runs.clear();
+        size_t wall_quad = 0;
+        for(int d = 0; d < 2; ++d)
+        {
+            for(const bool along_x : {true, false})
             {
-                skin_pixels.clear();
-                unsigned skin_w = 0, skin_h = 0;
-                lodepng::decode(skin_pixels, skin_w, skin_h, data + offset, skin_sz);
-                const unsigned w_b = skin_w * 4;
-                for(unsigned from_s = 0, from_e = ((skin_h - 1) * w_b); from_s < from_e; from_s += w_b, from_e -= w_b)
+                const int len = along_x ? width : height;
+                const float side = along_x ? d * height : d * width;
+                for(int i = 0; i < len; i += CHUNK_SIZE)
                 {
-                    std::swap_ranges(skin_pixels.begin() + from_e, skin_pixels.begin() + from_e + w_b, skin_pixels.begin() + from_s);
+                    const int n = std::min(CHUNK_SIZE, len - i);
+                    const float from = i;
+                    const float to = i + n;
+                    wall_runs.push_back(WallRun{
+                        wall_quad, size_t(n),
+                        along_x ? glm::vec3{from, -1.0f, side} : glm::vec3{side, -1.0f, from},
+                        along_x ? glm::vec3{to, 2.0f, side} : glm::vec3{side, 2.0f, to},
+                    });
+                    wall_quad += n;
                 }
-                skins[player_idx] = std::make_unique<Texture>(skin_w, skin_h, skin_pixels.data());
-                offset += skin_sz;
             }
-            player_idx++;
         }
 
-        wall_buf = std::make_unique<Buffer>(Buffer::Quads((width + height) * 2));
-        fill_walls(wall_buf->getAllVerts(), width, height);
+        world_chunks.clear();
+        size_t chunk_quad = 0;
+        for(int y = 0; y < height; y += CHUNK_SIZE)
+        {
+            for(int x = 0; x < width; x += CHUNK_SIZE)
+            {
+                const int w = std::min(CHUNK_SIZE, width - x);
+                const int h = std::min(CHUNK_SIZE, height - y);
+                world_chunks.push_back(WorldChunk{x, y, w, h, chunk_quad});
+                chunk_quad += w * h;
+            }
+        }
+
+        world.resize(width * height, '.');
+        const size_t terrain_size = stream.remaining();
+        if(!decompress_tiles(stream.bytes(terrain_size), terrain_size, world.data(), world.size()))
+        {
+            std::fill(world.begin(), world.end(), '.');
+        }
+        for(auto& s : world)
+        {
+            s |= 0x80;
+        }
 
-        world.resize(width * height, '.' | 0x80);
         lower_world_buf = std::make_unique<Buffer>(Buffer::Quads(width * height));
         upper_world_buf = std::make_unique<Buffer>(Buffer::Quads(width * height));
+        floor_buf = std::make_unique<Buffer>(Buffer::Quads(1));
+        fill_board_floor(floor_buf->getAllVerts(), width, height);
+        board_tex = std::make_unique<ByteTexture>(width, height);
+        minimap_tile_texels = std::min(MINIMAP_BOARD_MAX_TILE_SIZE, MINIMAP_BOARD_MAX_SIZE / std::max<int>(width, height));
+        minimap_board_frame = std::make_unique<Framebuffer>(width * minimap_tile_texels, height * minimap_tile_texels);
+        // only to allocate the levels, they're filled in chunk by chunk like the full size one
+        minimap_board_frame->generateMipmaps();
+        stale_chunks.assign(world_chunks.size(), false);
+        minimap_dirty_chunks.clear();
         render_world();
-        fill_counters(counters_buf.getAllVerts(), ServerWorldPacket{0,0,0,0}, total_bombs, true);
+        update_counters(total_bombs, 0, 0, 0);
 
         current_state = MineClient::State::Playing;
+        catchup_data.clear();
+        catchup_data.shrink_to_fit();
+
+        const auto queued = std::move(queued_packets);
+        queued_packets.clear();
+        for(const auto& q : queued)
+        {
+            receive_packet(q.data.data(), q.data.size(), q.channel, out_chat);
+        }
     }
-    else if(current_state == MineClient::State::Playing)
+    else if(current_state == MineClient::State::Playing && channel == CHANNEL_SKINS)
     {
-        memcpy(&sc_packet, data, sizeof(sc_packet));
-        if(sc_packet.result)
+        receive_skin_chunk(data, length);
+    }
+    else if(current_state == MineClient::State::Playing && channel == CHANNEL_CHAT)
+    {
+        receive_chat(data, length, out_chat);
+    }
+    else if(current_state == MineClient::State::Playing && channel == CHANNEL_CONTROL && control_kind(data, length) == CONTROL_PLAYER_JOINED)
+    {
+        receive_player_joined(data, length);
+    }
+    else if(current_state == MineClient::State::Playing && spectating)
+    {
+        if(channel != CHANNEL_CONTROL) return;
+
+        WireReader r(data, length);
+        SpectatorWorldPacket in;
+        if(!read_packet(r, in)) return;
+        auto take_header = [&]() {
+            sc_packet.placed_flags = in.placed_flags;
+            sc_packet.result = in.result;
+            sc_packet.seconds = in.seconds;
+            sc_packet.minutes = in.minutes;
+        };
+        if(in.result)
         {
+            take_header();
             if(sc_packet.result > 0)
             {
                 current_state = MineClient::State::Won;
@@ -851,96 +761,356 @@ void MineClient::receive_packet(unsigned char* data, size_t length, std::vector<
             return;
         }
 
-        size_t offset = sizeof(sc_packet);
-        ServerPlayerPacket in;
-        unsigned char idx = 0;
-        for(auto& player : players)
+        const size_t header_end = SpectatorWorldPacket::WIRE_SIZE;
+        BitReader players_in(data + header_end, length - header_end);
+        std::vector<PackedPlayer> states(players.size());
+        for(auto& state : states)
+        {
+            state = read_packed_player(players_in, nullptr, SPECTATOR_QUANTIZATION);
+        }
+        r.bytes(players_in.finish());
+        if(!players_in.ok() || !r.ok()) return;
+        // the tiles have to be all there before any of it is applied
+        const size_t tile_bytes = in.keyframe ? world.size() : size_t(in.changed_tiles) * TileChangePacket::WIRE_SIZE;
+        if(r.remaining() != tile_bytes) return;
+        take_header();
+        for(size_t i = 0; i < players.size(); ++i)
+        {
+            players[i].unpack(states[i], SPECTATOR_QUANTIZATION, width, height);
+        }
+        record_snapshots(in.tick);
+
+        if(in.keyframe)
+        {
+            const auto tiles = r.bytes(world.size());
+            for(size_t i = 0; i < world.size(); ++i)
+            {
+                world[i] = tiles[i] | 0x80;
+            }
+        }
+        else
+        {
+            TileChangePacket tile;
+            for(enet_uint16 i = 0; i < in.changed_tiles; ++i)
+            {
+                read_packet(r, tile);
+                if(tile.idx < world.size()) world[tile.idx] = tile.tile | 0x80;
+            }
+        }
+
+        render_world();
+        update_counters(total_bombs, sc_packet.placed_flags, sc_packet.seconds, sc_packet.minutes);
+    }
+    else if(current_state == MineClient::State::Playing)
+    {
+        if(channel != CHANNEL_WORLD) return;
+
+        WireReader r(data, length);
+        ServerWorldPacket in;
+        if(!read_packet(r, in)) return;
+        if(in.result)
         {
-            memcpy(&in, data + offset, sizeof(in));
-            if(idx != my_player_id)
+            sc_packet = in;
+            if(sc_packet.result > 0)
+            {
+                current_state = MineClient::State::Won;
+            }
+            else
             {
-                player.fill(in);
+                current_state = MineClient::State::Lost;
             }
-            offset += sizeof(in);
-            idx += 1;
+            return;
+        }
+
+        const enet_uint32 tick = in.tick;
+        const enet_uint32 baseline_tick = in.baseline_tick;
+        const auto baseline = std::find_if(received_states.begin(), received_states.end(), [baseline_tick](const ReceivedStates& r) {
+            return r.tick == baseline_tick;
+        });
+        if(baseline_tick != 0 && baseline == received_states.end())
+        {
+            // can't happen as long as we keep more snapshots than the server does
+            fprintf(stderr, "Snapshot %u is relative to unknown snapshot %u\n", tick, baseline_tick);
+            return;
         }
 
-        memcpy(world.data(), data + offset, world.size());
-        offset += world.size();
-        if(offset < length)
+        const size_t header_end = ServerWorldPacket::WIRE_SIZE;
+        BitReader players_in(data + header_end, length - header_end);
+        ReceivedStates received{tick, {}};
+        received.states.reserve(players.size());
+        for(size_t i = 0; i < players.size(); ++i)
         {
-            if(out_chat.size() == (MAX_CHAT_LINES / 2))
+            const PackedPlayer* base = baseline_tick != 0 ? &baseline->states[i] : nullptr;
+            received.states.push_back(read_packed_player(players_in, base, PLAYER_QUANTIZATION));
+        }
+        r.bytes(players_in.finish());
+        if(!players_in.ok() || !r.ok()) return;
+        // the tiles have to be all there before any of it is applied
+        if(r.remaining() != size_t(in.changed_tiles) * TileChangePacket::WIRE_SIZE) return;
+        sc_packet = in;
+
+        for(size_t i = 0; i < players.size(); ++i)
+        {
+            if(i != my_player_id)
             {
-                std::rotate(out_chat.begin(), out_chat.begin() + 1, out_chat.end());
+                players[i].unpack(received.states[i], PLAYER_QUANTIZATION, width, height);
             }
             else
             {
-                out_chat.push_back(std::make_unique<char[]>(MAX_CHAT_LINE_LEN + 2));
+                // our own position is ours to decide, only take the ack
+                players[i].input_sequence = received.states[i].sequence;
             }
-            char* write_to = out_chat.back().get();
-            memset(write_to, 0, MAX_CHAT_LINE_LEN + 2);
-            memcpy(write_to, data + offset, length - offset);
-            fill_chat(chat_buf.getAllVerts(), out_chat, players);
+        }
+        received_states.push_back(std::move(received));
+        if(received_states.size() > RECEIVED_STATES_KEPT) received_states.pop_front();
+        record_snapshots(tick);
+
+        TileChangePacket tile;
+        for(enet_uint16 i = 0; i < sc_packet.changed_tiles; ++i)
+        {
+            read_packet(r, tile);
+            if(tile.idx < world.size()) world[tile.idx] = tile.tile | 0x80;
         }
 
         render_world();
-        fill_counters(counters_buf.getAllVerts(), sc_packet, 0, false);
+        update_counters(total_bombs, sc_packet.placed_flags, sc_packet.seconds, sc_packet.minutes);
     }
 }
-void MineClient::disconnect(bool change_state)
+void MineClient::receive_chat(const unsigned char* data, size_t length, std::vector<std::unique_ptr<char[]>>& out_chat)
 {
-    if(host)
+    WireReader r(data, length);
+    ChatBatchPacket batch;
+    if(!read_packet(r, batch)) return;
+
+    ChatLinePacket line;
+    for(unsigned char i = 0; i < batch.count; ++i)
     {
-        ENetEvent event;
-        bool done = false;
+        if(!read_packet(r, line) || line.length > MAX_CHAT_LINE_LEN_TXT) break;
+        const auto text = r.bytes(line.length);
+        if(!text) break;
+        if(line.player >= players.size()) continue;
 
-        enet_peer_disconnect(peer, 0);
-        while(enet_host_service(host.get(), &event, 1000) > 0)
+        if(out_chat.size() == (MAX_CHAT_LINES / 2))
         {
-            switch (event.type)
+            std::rotate(out_chat.begin(), out_chat.begin() + 1, out_chat.end());
+        }
+        else
+        {
+            out_chat.push_back(std::make_unique<char[]>(MAX_CHAT_LINE_LEN + 2));
+        }
+        // who said it, then what they said
+        char* write_to = out_chat.back().get();
+        memset(write_to, 0, MAX_CHAT_LINE_LEN + 2);
+        write_to[0] = line.player;
+        memcpy(write_to + 1, text, line.length);
+    }
+    fill_chat(out_chat);
+}
+void MineClient::fill_chat(const std::vector<std::unique_ptr<char[]>>& lines)
+{
+    // a line is who said it on one row and what they said on the next
+    for(size_t i = 0; i < chat_rows.size(); ++i)
+    {
+        std::string_view text;
+        glm::vec4 color = solidWhite;
+        if(i / 2 < lines.size())
+        {
+            const char* ln = lines[i / 2].get();
+            if(i % 2 == 0)
+            {
+                const auto& player = players[(unsigned char)ln[0]];
+                text = std::string_view{player.username, strnlen(player.username, MAX_NAME_LEN)};
+                color = player.color;
+            }
+            else
             {
-            case ENET_EVENT_TYPE_RECEIVE:
-                enet_packet_destroy(event.packet);
-                break;
-            case ENET_EVENT_TYPE_DISCONNECT:
-                done = true;
-                break;
-            default:
-                break;
+                text = std::string_view{ln + 1, strnlen(ln + 1, MAX_CHAT_LINE_LEN_TXT)};
             }
         }
+        chat_frame_dirty |= chat_rows[i].set(chat_buf, text, color);
+    }
+}
+void MineClient::update_counters(enet_uint16 new_bombs, enet_uint16 new_flags, unsigned char new_seconds, unsigned char new_minutes)
+{
+    char timer[8];
+    snprintf(timer, sizeof(timer), "%u%u:%u%u", (new_minutes / 10u) % 10u, new_minutes % 10u, new_seconds / 10u, new_seconds % 10u);
+    // whatever didn't change since the last packet isn't written again
+    timer_text.set(hud.buffer(), timer, solidBlack);
+    bombs_text.set(hud.buffer(), four_digits(new_bombs), solidBlack);
+    flags_text.set(hud.buffer(), four_digits(new_flags), solidBlack);
+}
+
+void MineClient::receive_player_joined(const unsigned char* data, size_t length)
+{
+    WireReader r(data, length);
+    PlayerJoinedPacket in;
+    if(!read_packet(r, in) || r.remaining() != 0 || in.player >= players.size()) return;
+    if(!spectating && in.player == my_player_id) return;
+
+    auto& player = players[in.player];
+    player.fill(in.meta);
+    fill_name(player_names_buf[in.player], std::string_view{player.username, strnlen(player.username, MAX_NAME_LEN)});
+
+    // the previous skin stays in the player's layer, unused until the new one is uploaded over it
+    player_skins[in.player] = in.meta.skinbytes ? in.skin : SkinHash{};
+    skin_uploaded[in.player] = false;
+    request_skins();
+}
+
+void MineClient::request_skins()
+{
+    // skins not uploaded yet, except the ones already on their way
+    std::vector<SkinHash> wanted;
+    for(size_t i = 0; i < player_skins.size(); ++i)
+    {
+        const auto& hash = player_skins[i];
+        if(hash != SkinHash{} && !skin_uploaded[i] && skin_downloads.find(hash) == skin_downloads.end()
+            && std::find(wanted.begin(), wanted.end(), hash) == wanted.end())
+        {
+            wanted.push_back(hash);
+        }
+    }
 
-        if(!done) enet_peer_reset(peer);
-        host.reset();
+    std::vector<unsigned char> cached;
+    std::vector<SkinHash> missing;
+    for(const auto& hash : wanted)
+    {
+        if(read_cached_skin(skin_cache_dir, hash, cached))
+        {
+            skin_decoder.push(hash, std::move(cached));
+        }
+        else
+        {
+            missing.push_back(hash);
+        }
     }
-    if(change_state) current_state = MineClient::State::Disconnected;
+    if(missing.empty()) return;
+
+    // only chunks of skins asked for are taken
+    for(const auto& hash : missing)
+    {
+        skin_downloads[hash];
+    }
+    auto request = enet_packet_create(nullptr, missing.size() * std::tuple_size<SkinHash>::value, ENET_PACKET_FLAG_RELIABLE);
+    WireWriter w(request->data, request->dataLength);
+    for(const auto& hash : missing)
+    {
+        write_packet(w, hash);
+    }
+    net->send(request, CHANNEL_SKINS);
 }
-void MineClient::cancel()
+
+void MineClient::receive_skin_chunk(const unsigned char* data, size_t length)
+{
+    WireReader r(data, length);
+    SkinChunkPacket chunk;
+    if(!read_packet(r, chunk) || r.remaining() > CATCHUP_CHUNK_SIZE) return;
+    const size_t total = chunk.total;
+    const size_t chunk_offset = chunk.offset;
+    const size_t chunk_size = r.remaining();
+    if(total > MAX_SKIN_BYTES || chunk_offset > total || chunk_size > total - chunk_offset) return;
+
+    const auto it = skin_downloads.find(chunk.skin);
+    if(it == skin_downloads.end()) return;
+    auto& download = it->second;
+    // the server sends a skin's chunks in order on a reliable channel, anything else is dropped
+    if(chunk_offset == 0)
+    {
+        download.data.resize(total);
+        download.received = 0;
+    }
+    else if(chunk_offset != download.received || total != download.data.size())
+    {
+        return;
+    }
+    memcpy(download.data.data() + chunk_offset, r.bytes(chunk_size), chunk_size);
+    download.received += chunk_size;
+    if(download.received < total) return;
+
+    auto skin = std::move(download.data);
+    skin_downloads.erase(it);
+    if(hash_skin(skin.data(), skin.size()) != chunk.skin) return;
+
+    write_cached_skin(skin_cache_dir, chunk.skin, skin.data(), skin.size());
+    skin_decoder.push(chunk.skin, std::move(skin));
+}
+
+void MineClient::upload_skins()
 {
-    if(host)
+    // a few per frame, players keep the default skin until theirs is uploaded
+    DecodedSkin decoded;
+    for(size_t uploaded = 0; uploaded < MAX_SKIN_UPLOADS_PER_FRAME && skin_decoder.pop(decoded); ++uploaded)
     {
-        ENetEvent event;
-        bool done = false;
+        if(decoded.pixels.empty()) continue;
 
-        enet_peer_disconnect(peer, 0);
-        while(enet_host_service(host.get(), &event, 1000) > 0)
+        for(size_t i = 0; i < player_skins.size(); ++i)
         {
-            switch (event.type)
+            if(player_skins[i] == decoded.hash && !skin_uploaded[i])
             {
-            case ENET_EVENT_TYPE_RECEIVE:
-                enet_packet_destroy(event.packet);
-                break;
-            case ENET_EVENT_TYPE_DISCONNECT:
-                done = true;
-                break;
-            default:
-                break;
+                skin_array->upload(i + 1, decoded.pixels.data());
+                skin_uploaded[i] = true;
             }
         }
+    }
+}
+
+void MineClient::record_snapshots(enet_uint32 tick)
+{
+    const float server_time = clock.on_snapshot(tick);
+    if(!spectating) clock.on_input_acked(players[my_player_id].input_sequence);
+
+    for(size_t i = 0; i < players.size(); ++i)
+    {
+        if(spectating || i != my_player_id) player_snapshots[i].push(server_time, players[i]);
+    }
+}
 
-        if(!done) enet_peer_reset(peer);
-        host.reset();
+void MineClient::interpolate_players()
+{
+    if(!clock.synced()) return;
+
+    // far enough behind to always have a newer snapshot, unless one is lost
+    const float delay = std::max(INTERPOLATION_DELAY, clock.snapshot_spacing() * 1.25f);
+    const float render_time = clock.server_now() - delay;
+    for(size_t i = 0; i < players.size(); ++i)
+    {
+        if(spectating || i != my_player_id) player_snapshots[i].sample(render_time, players[i]);
+    }
+}
+
+void MineClient::poll_network(std::vector<std::unique_ptr<char[]>>& out_chat)
+{
+    NetEvent event;
+    while(net && net->poll(event))
+    {
+        switch(event.type)
+        {
+        case ENET_EVENT_TYPE_RECEIVE:
+            receive_packet(event.packet->data, event.packet->dataLength, event.channel, out_chat);
+            enet_packet_destroy(event.packet);
+            break;
+        case ENET_EVENT_TYPE_DISCONNECT:
+            disconnect(true);
+            break;
+        default:
+            break;
+        }
     }
+}
+
+bool MineClient::is_connected() const
+{
+    return bool(net);
+}
+
+void MineClient::disconnect(bool change_state)
+{
+    net = nullptr;
+    if(change_state) current_state = MineClient::State::Disconnected;
+}
+void MineClient::cancel()
+{
+    net = nullptr;
     current_state = MineClient::State::Cancelled;
 }
 
@@ -951,7 +1121,7 @@ void MineClient::handle_events(GLFWwindow* window, float mouse_sensitivity, int
     for(auto& p : players)
     {
         auto i = idx++;
-        if(i == my_player_id) continue;
+        if(!spectating && i == my_player_id) continue;
 
         if((roundf(p.movedDistance * 100.0f) / 100.0f) == 0.0f)
         {
@@ -1006,6 +1176,38 @@ void MineClient::handle_events(GLFWwindow* window, float mouse_sensitivity, int
         released_esc = true;
     }
 
+    if(spectating)
+    {
+        // clicks cycle through the players to follow
+        const int player_count = players.size();
+        if(glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS)
+        {
+            if(!pressed_m1)
+            {
+                pressed_m1 = true;
+                my_player_id = (my_player_id + 1) % player_count;
+            }
+        }
+        else
+        {
+            pressed_m1 = false;
+        }
+
+        if(glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS)
+        {
+            if(!pressed_m2)
+            {
+                pressed_m2 = true;
+                my_player_id = (my_player_id + player_count - 1) % player_count;
+            }
+        }
+        else
+        {
+            pressed_m2 = false;
+        }
+        return;
+    }
+
     static bool released_enter = true;
     if(glfwGetKey(window, GLFW_KEY_ENTER) == GLFW_PRESS)
     {
@@ -1047,12 +1249,7 @@ void MineClient::handle_events(GLFWwindow* window, float mouse_sensitivity, int
         released_bp = true;
     }
 
-    static size_t prev_typed_size = 0;
-    if(typed_str.size() != prev_typed_size)
-    {
-        prev_typed_size = typed_str.size();
-        fill_typed(chat_buf.getAllVerts());
-    }
+    chat_frame_dirty |= typed_text.set(chat_buf, typed_str, solidWhite);
 
     double xpos, ypos;
     glfwGetCursorPos(window, &xpos, &ypos);
@@ -1136,16 +1333,16 @@ void MineClient::handle_events(GLFWwindow* window, float mouse_sensitivity, int
     auto& playa = players[my_player_id];
     playa.yaw += xoffset * mouse_sensitivity;
     playa.yaw %= 360;
-    int16_t yaw = playa.yaw;
-    memcpy(&cs_packet.yaw, &yaw, sizeof(int16_t));
+    const int16_t yaw = playa.yaw;
+    cs_packet.yaw = enet_uint16(yaw);
 
     playa.pitch += yoffset * mouse_sensitivity;
     if(fabs(playa.pitch) >= 89.0f)
     {
         playa.pitch = copysign(89.0f, playa.pitch);
     }
-    int16_t pitch = playa.pitch;
-    memcpy(&cs_packet.pitch, &pitch, sizeof(int16_t));
+    const int16_t pitch = playa.pitch;
+    cs_packet.pitch = enet_uint16(pitch);
 
     if(going_mag == 0 && !is_typing)
     {
@@ -1233,6 +1430,9 @@ void MineClient::handle_events(GLFWwindow* window, float mouse_sensitivity, int
 
 void MineClient::render(MineClient::RenderInfo& info)
 {
+    upload_skins();
+    interpolate_players();
+
     const auto& self = players[my_player_id];
 
     glEnable(GL_CULL_FACE);
@@ -1241,169 +1441,140 @@ void MineClient::render(MineClient::RenderInfo& info)
     // bind textures on corresponding texture units
     info.spritesheet.bind();
 
-    // activate shader
-    info.worldShader.use();
-
-    // pass projection matrix to shader (note that in this case it could change every frame)
-    glm::mat4 projection = glm::perspective(glm::radians(info.fov), (float)info.display_w / (float)info.display_h, 0.1f, 100.0f);
-    info.worldShader.setMat4("projection", projection);
+    // every 3D program reads view and projection from the Camera block, set once per frame
+    const CameraBlock camera{
+        get_view_matrix(),
+        glm::perspective(glm::radians(info.fov), (float)info.display_w / (float)info.display_h, 0.1f, FAR_PLANE),
+    };
+    camera_buf.update(&camera);
+    const Frustum frustum(camera.projection * camera.view);
 
-    // camera/view transformation
-    glm::mat4 view = get_view_matrix();
-    info.worldShader.setMat4("view", view);
+    // activate shader
+    info.worldProgram.use();
 
     glm::mat4 model = glm::mat4(1.0f);
-    info.worldShader.setMat4("model", model);
+    info.worldProgram.model.set(model);
 
-    info.worldShader.setVec4("constColor", solidWhite);
+    info.worldProgram.constColor.set(solidWhite);
 
     wall_buf->bind();
-    wall_buf->draw();
+    for(const auto& run : wall_runs)
+    {
+        if(frustum.sees_box(run.min, run.max)) wall_buf->drawQuads(run.first_quad, run.quads);
+    }
+
+    if(info.board_texture)
+    {
+        draw_board_floor(info.worldProgram, board_layer_model(BoardLayer::Floor));
+    }
+    else
+    {
+        // both layers sit at y = -1, give or take the gap between them
+        const auto chunk_visible = [&](const WorldChunk& chunk) {
+            return frustum.sees_box(glm::vec3{chunk.x, -1.0f, chunk.y}, glm::vec3{chunk.x + chunk.w, -1.0f, chunk.y + chunk.h});
+        };
+        // also brings the chunks up to date for the minimap, which draws them later
+        for(size_t c = 0; c < world_chunks.size(); ++c)
+        {
+            if(stale_chunks[c]) render_chunk(c);
+        }
 
-    lower_world_buf->bind();
-    lower_world_buf->draw();
-    upper_world_buf->bind();
-    upper_world_buf->draw();
+        info.worldProgram.model.set(board_layer_model(BoardLayer::Floor));
+        lower_world_buf->bind();
+        for(const auto& chunk : world_chunks)
+        {
+            if(chunk_visible(chunk)) lower_world_buf->drawQuads(chunk.first_quad, chunk.w * chunk.h);
+        }
+        info.worldProgram.model.set(board_layer_model(BoardLayer::Tiles));
+        upper_world_buf->bind();
+        for(const auto& chunk : world_chunks)
+        {
+            if(chunk_visible(chunk)) upper_world_buf->drawQuads(chunk.first_quad, chunk.w * chunk.h);
+        }
+    }
 
-    // player cursor
-    cursor_buf.bind();
+    // player cursors
+    instances.clear();
     for(unsigned char i = 0; i < players.size(); ++i)
     {
         const auto& playa = players[i];
         if(playa.looking_at_x != -1 && playa.looking_at_y != -1)
         {
-            info.worldShader.setVec4("constColor", playa.color);
-            model = glm::translate(glm::mat4(1.0f), glm::vec3{playa.looking_at_x, 0.0f, playa.looking_at_y + 1});
-            info.worldShader.setMat4("model", model);
-            cursor_buf.draw();
+            model = glm::translate(board_layer_model(BoardLayer::Cursor), glm::vec3{playa.looking_at_x, 0.0f, playa.looking_at_y + 1});
+            instances.push_back(Instance{model, playa.color, glm::vec4(0.0f)});
         }
     }
+    info.instancedProgram.use();
+    info.instancedProgram.flatInstances.set(false);
+    info.instancedProgram.constColor.set(solidWhite);
+    cursor_buf.bind();
+    cursor_buf.setInstances(instances.data(), instances.size());
+    cursor_buf.drawInstanced();
 
+    info.avatarShader.use();
+    instances.clear();
     for(unsigned char i = 0; i < players.size(); ++i)
     {
         if(i == my_player_id) continue;
 
+        // the avatar hangs from about 1.2 below its position to a little above it
         const auto& playa = players[i];
-        if(auto& sk = skins[i]; sk)
-        {
-            info.worldShader.setVec4("constColor", solidWhite);
-            sk->bind();
-        }
-        else
-        {
-            info.worldShader.setVec4("constColor", playa.color);
-            default_skin_tex.bind();
-        }
-
-        const auto playerSpinMat = glm::rotate(glm::translate(glm::mat4(1.0f), playa.position), glm::radians(-(float(playa.yaw) + 90.0f)), glm::vec3{0, 1, 0});
-
-        model = glm::translate(playerSpinMat, glm::vec3{0.0f, -0.35f, 0.0f});
-        model = glm::scale(model, glm::vec3{0.25f, 0.45f, 0.125f});
-        info.worldShader.setMat4("model", model);
-        player_body_buf.bind();
-        player_body_buf.draw();
-        info.worldShader.setMat4("model", glm::scale(model, outerScaleVec));
-        player_coat_buf.bind();
-        player_coat_buf.draw();
-
-        const auto swingRads = glm::radians(playa.movementSwing);
-
-        model = playerSpinMat;
-        auto armMat = model;
-
-        model = armMat;
-        model = glm::translate(model, glm::vec3{0, -(0.125 + (0.45f / 2.0f)), 0});
-        model = glm::translate(model, glm::vec3{+(0.125f + 0.0625f), 0, 0});
-        model = glm::translate(model, glm::vec3{0, sinf(fabs(swingRads)) * (0.0625f * 1.5f), -sinf(swingRads) * 0.25f});
-        model = glm::rotate(model, swingRads, glm::vec3{1, 0, 0});
-        model = glm::scale(model, glm::vec3{0.125f, 0.45f, 0.125f});
-        info.worldShader.setMat4("model", model);
-        player_arm_left_buf.bind();
-        player_arm_left_buf.draw();
-        info.worldShader.setMat4("model", glm::scale(model, outerScaleVec));
-        player_sleeve_left_buf.bind();
-        player_sleeve_left_buf.draw();
-        
-        model = armMat;
-        model = glm::translate(model, glm::vec3{0, -(0.125 + (0.45f / 2.0f)), 0});
-        model = glm::translate(model, glm::vec3{-(0.125f + 0.0625f), 0, 0});
-        model = glm::translate(model, glm::vec3{0, sinf(fabs(swingRads)) * (0.0625f * 1.5f), sinf(swingRads) * 0.25f});
-        model = glm::rotate(model, -swingRads, glm::vec3{1, 0, 0});
-        model = glm::scale(model, glm::vec3{0.125f, 0.45f, 0.125f});
-        info.worldShader.setMat4("model", model);
-        player_arm_right_buf.bind();
-        player_arm_right_buf.draw();
-        info.worldShader.setMat4("model", glm::scale(model, outerScaleVec));
-        player_sleeve_right_buf.bind();
-        player_sleeve_right_buf.draw();
-
-        model = playerSpinMat;
-        auto legMat = model;
-
-        model = legMat;
-        model = glm::translate(model, glm::vec3{0, -(0.125 + 0.45f + (0.425f / 2.0f)), 0});
-        model = glm::translate(model, glm::vec3{+0.0625f, 0, 0});
-        model = glm::translate(model, glm::vec3{0, sinf(fabs(swingRads)) * (0.0625f * 1.5f), sinf(swingRads) * 0.25f});
-        model = glm::rotate(model, -swingRads, glm::vec3{1, 0, 0});
-        model = glm::scale(model, glm::vec3{0.125f, 0.425f, 0.125f});
-        info.worldShader.setMat4("model", model);
-        player_leg_left_buf.bind();
-        player_leg_left_buf.draw();
-        info.worldShader.setMat4("model", glm::scale(model, outerScaleVec));
-        player_pant_left_buf.bind();
-        player_pant_left_buf.draw();
-        
-        model = legMat;
-        model = glm::translate(model, glm::vec3{0, -(0.125 + 0.45f + (0.425f / 2.0f)), 0});
-        model = glm::translate(model, glm::vec3{-0.0625f, 0, 0});
-        model = glm::translate(model, glm::vec3{0, sinf(fabs(swingRads)) * (0.0625f * 1.5f), -sinf(swingRads) * 0.25f});
-        model = glm::rotate(model, swingRads, glm::vec3{1, 0, 0});
-        model = glm::scale(model, glm::vec3{0.125f, 0.425f, 0.125f});
-        info.worldShader.setMat4("model", model);
-        player_leg_right_buf.bind();
-        player_leg_right_buf.draw();
-        info.worldShader.setMat4("model", glm::scale(model, outerScaleVec));
-        player_pant_right_buf.bind();
-        player_pant_right_buf.draw();
-
-        model = glm::rotate(playerSpinMat, glm::radians(float(playa.pitch)), glm::vec3{1, 0, 0});
-        model = glm::scale(model, glm::vec3{0.25f, 0.25f, 0.25f});
-        info.worldShader.setMat4("model", model);
-        player_head_buf.bind();
-        player_head_buf.draw();
-        info.worldShader.setMat4("model", glm::scale(model, outerScaleVec));
-        player_helm_buf.bind();
-        player_helm_buf.draw();
+        if(!frustum.sees_sphere(playa.position - glm::vec3{0.0f, 0.5f, 0.0f}, 1.0f)) continue;
+
+        // players whose skin isn't there yet get the default one tinted with their color
+        const bool has_skin = skin_uploaded[i];
+        instances.push_back(Instance{
+            glm::rotate(glm::translate(glm::mat4(1.0f), playa.position), glm::radians(-(float(playa.yaw) + 90.0f)), glm::vec3{0, 1, 0}),
+            has_skin ? solidWhite : playa.color,
+            glm::vec4{glm::radians(float(playa.pitch)), glm::radians(playa.movementSwing), has_skin ? float(i + 1) : 0.0f, 0.0f},
+        });
     }
+    skin_array->bind();
+    avatar_buf.bind();
+    avatar_buf.setInstances(instances.data(), instances.size());
+    avatar_buf.drawInstanced();
 
+    info.worldProgram.use();
     info.spritesheet.bind();
 
-    info.worldShader.setVec4("constColor", solidWhite);
+    info.worldProgram.constColor.set(solidWhite);
 
     for(unsigned char i = 0; i < players.size(); ++i)
     {
         if(i == my_player_id) continue;
 
         const auto& playa = players[i];
+        if(glm::distance(playa.position, self.position) > NAME_DRAW_DISTANCE) continue;
+        if(!frustum.sees_sphere(playa.position + glm::vec3{0.0f, 1.25f, 0.0f}, 1.0f)) continue;
+
         auto& buf = player_names_buf[i];
         model = glm::inverse(glm::lookAt(playa.position, self.position, glm::vec3(0, 1, 0)));
-        info.worldShader.setMat4("model", model);
+        info.worldProgram.model.set(model);
         buf.bind();
         buf.draw();
     }
 
     glDisable(GL_CULL_FACE);
     glDisable(GL_DEPTH_TEST);
-    info.flatShader.use();
-    info.flatShader.setMat4("model", glm::mat4(1.0f));
-    info.flatShader.setVec4("constColor", solidWhite);
+    info.flatProgram.use();
+    info.flatProgram.model.set(glm::mat4(1.0f));
+    info.flatProgram.constColor.set(solidWhite);
 
-    chat_frame.bind();
-    glClearColor(0.0f, 0.0f, 0.0f, 0.5f);
-    glClear(GL_COLOR_BUFFER_BIT);
+    if(chat_frame_dirty)
+    {
+        chat_frame.bind();
+        glClearColor(0.0f, 0.0f, 0.0f, 0.5f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        chat_buf.bind();
+        chat_buf.draw();
+        chat_frame_dirty = false;
+    }
 
-    chat_buf.bind();
-    chat_buf.draw();
+    if(!minimap_dirty_chunks.empty())
+    {
+        render_minimap_board(info);
+    }
 
     minimap_frame.bind();
     glClearColor(0, 1, 0, 1.0f);
@@ -1422,20 +1593,19 @@ void MineClient::render(MineClient::RenderInfo& info)
         self.position[2] - (self.position[2] * minimap_scale)
     });
     model = glm::scale(model, glm::vec3{minimap_scale, 1.0f, minimap_scale});
-    info.flatShader.setMat4("model", top_view * model);
-
-    lower_world_buf->bind();
-    lower_world_buf->draw();
-    upper_world_buf->bind();
-    upper_world_buf->draw();
+    // the board quad's uvs go 0 to 1 across it, just like the cached board
+    minimap_board_frame->bindOutput();
+    info.flatProgram.model.set(top_view * model * board_layer_model(BoardLayer::Floor));
+    floor_buf->bind();
+    floor_buf->draw();
+    info.spritesheet.bind();
 
-    indicator_buf.bind();
+    instances.clear();
     for(unsigned char i = 0; i < players.size(); ++i)
     {
         const auto& playa = players[i];
         glm::vec4 col = playa.color;
         col[3] = 1.0f;
-        info.flatShader.setVec4("constColor", col);
         model = glm::translate(glm::mat4(1.0f), glm::vec3{
             (self.position[0] - players[i].position[0]) * minimap_scale,
             (players[i].position[2] - self.position[2]) * minimap_scale,
@@ -1443,40 +1613,46 @@ void MineClient::render(MineClient::RenderInfo& info)
         });
         model = glm::rotate(model, glm::radians(-(float(playa.yaw) + 180.0f)), glm::vec3{0.0f, 0.0f, 1.0f});
         model = glm::scale(model,  glm::vec3(0.25f + 0.0625f));
-        info.flatShader.setMat4("model", model);
-        indicator_buf.draw();
+        instances.push_back(Instance{model, col, glm::vec4(0.0f)});
     }
+    // already in the minimap's clip space
+    info.instancedProgram.use();
+    info.instancedProgram.flatInstances.set(true);
+    indicator_buf.bind();
+    indicator_buf.setInstances(instances.data(), instances.size());
+    indicator_buf.drawInstanced();
 
-    info.flatShader.setVec4("constColor", solidWhite);
+    info.flatProgram.use();
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glViewport(0, 0, info.display_w, info.display_h);
 
-    chat_frame.bindOutput();
+    // the whole HUD is in screen space, drawn once per texture
+    const glm::mat4 overlay_model = glm::scale(
+        glm::translate(glm::mat4(1.0f), glm::vec3{Overlay_TL_x, Overlay_TL_y, 0.0f}),
+        glm::vec3{info.overlay_w / 50.0f, (info.overlay_h * 75.0f) / (50.0f * 50.0f), 1.0f}
+    );
+    if(overlay_model != counters_model)
+    {
+        counters_model = overlay_model;
+        timer_text.move(hud.buffer(), counter_layout(0, 0, overlay_model));
+        bombs_text.move(hud.buffer(), counter_layout(1, 1, overlay_model));
+        flags_text.move(hud.buffer(), counter_layout(2, 1, overlay_model));
+    }
+
+    hud.begin();
 
+    hud.use(chat_frame.output());
     model = glm::translate(glm::mat4(1.0f), glm::vec3{1.0f - (info.overlay_w / 50.0f), -1.0f + ((info.overlay_h * 50.0f) / (50.0f * 50.0f)), 0.0f});
     model = glm::scale(model, glm::vec3{info.overlay_w / 50.0f, ((info.overlay_h * 50.0f) / (50.0f * 50.0f)), 1.0f});
-    info.flatShader.setMat4("model", model);
-
-    chat_visible_buf.bind();
-    chat_visible_buf.draw();
-
-    minimap_frame.bindOutput();
-
-    model = glm::translate(glm::mat4(1.0f), glm::vec3{Overlay_TL_x, Overlay_TL_y, 0.0f});
-    model = glm::scale(model, glm::vec3{info.overlay_w / 50.0f, (info.overlay_h * 75.0f) / (50.0f * 50.0f), 1.0f});
-    info.flatShader.setMat4("model", model);
+    hud.add(hud_unit_quad, whole_texture_uv, solidWhite, model);
 
-    minimap_buf.bind();
-    minimap_buf.draw();
+    hud.use(minimap_frame.output());
+    hud.add(hud_minimap_quad, whole_texture_uv, solidWhite, overlay_model);
 
-    info.spritesheet.bind();
-
-    overlay_buf.bind();
-    overlay_buf.draw();
-
-    counters_buf.bind();
-    counters_buf.draw();
+    hud.use(info.spritesheet);
+    hud.add(hud_unit_quad, overlay_uv, solidWhite, overlay_model);
+    hud.keep(HUD_COUNTER_QUADS);
 
     const float crosshair_size_y = info.crosshair_width / float(info.display_h);
     const float crosshair_size_x = info.crosshair_width / float(info.display_w);
@@ -1485,63 +1661,47 @@ void MineClient::render(MineClient::RenderInfo& info)
     const float crosshair_distance_from_center_y = info.crosshair_distance * 2.0f / info.display_h;
     const float crosshair_distance_from_center_x = info.crosshair_distance * 2.0f / info.display_w;
 
-    crosshair_buf.bind();
-
     model = glm::mat4(1.0f);
     const auto model_pos_vert_u = glm::translate(model, glm::vec3{0.0f, +(crosshair_distance_from_center_y + crosshair_length_y/2.0f), 0.0f});
     const auto model_pos_vert_d = glm::translate(model, glm::vec3{0.0f, -(crosshair_distance_from_center_y + crosshair_length_y/2.0f), 0.0f});
     const auto model_pos_hori_r = glm::translate(model, glm::vec3{+(crosshair_distance_from_center_x + crosshair_length_x/2.0f), 0.0f, 0.0f});
     const auto model_pos_hori_l = glm::translate(model, glm::vec3{-(crosshair_distance_from_center_x + crosshair_length_x/2.0f), 0.0f, 0.0f});
 
-    info.flatShader.setVec4("constColor", self.color);
+    hud.add(hud_crosshair_quad, plain_color_uv, self.color, glm::scale(model_pos_vert_u, glm::vec3{crosshair_size_x, crosshair_length_y, 1.0f}));
+    hud.add(hud_crosshair_quad, plain_color_uv, self.color, glm::scale(model_pos_vert_d, glm::vec3{crosshair_size_x, crosshair_length_y, 1.0f}));
+    hud.add(hud_crosshair_quad, plain_color_uv, self.color, glm::scale(model_pos_hori_l, glm::vec3{crosshair_length_x, crosshair_size_y, 1.0f}));
+    hud.add(hud_crosshair_quad, plain_color_uv, self.color, glm::scale(model_pos_hori_r, glm::vec3{crosshair_length_x, crosshair_size_y, 1.0f}));
 
-    model = glm::scale(model_pos_vert_u, glm::vec3{crosshair_size_x, crosshair_length_y, 1.0f});
-    info.flatShader.setMat4("model", model);
-    crosshair_buf.draw();
-
-    model = glm::scale(model_pos_vert_d, glm::vec3{crosshair_size_x, crosshair_length_y, 1.0f});
-    info.flatShader.setMat4("model", model);
-    crosshair_buf.draw();
-
-    model = glm::scale(model_pos_hori_l, glm::vec3{crosshair_length_x, crosshair_size_y, 1.0f});
-    info.flatShader.setMat4("model", model);
-    crosshair_buf.draw();
-
-    model = glm::scale(model_pos_hori_r, glm::vec3{crosshair_length_x, crosshair_size_y, 1.0f});
-    info.flatShader.setMat4("model", model);
-    crosshair_buf.draw();
+    info.flatProgram.model.set(glm::mat4(1.0f));
+    hud.draw();
 }
 
 void MineClient::send()
 {
-    if(host)
+    if(net && !spectating)
     {
-        const size_t s = sizeof(cs_packet) + (send_str ? typed_str.size() : 0);
-        auto buf = std::make_unique<char[]>(s);
+        auto packet = enet_packet_create(nullptr, ClientPlayerPacket::WIRE_SIZE, 0);
         const auto& playa = players[my_player_id];
-        cs_packet.x = ENET_HOST_TO_NET_32(enet_uint32(playa.position[0] * POS_SCALE));
-        cs_packet.y = ENET_HOST_TO_NET_32(enet_uint32(playa.position[2] * POS_SCALE));
-        cs_packet.yaw = ENET_HOST_TO_NET_16(cs_packet.yaw);
-        cs_packet.pitch = ENET_HOST_TO_NET_16(cs_packet.pitch);
+        cs_packet.sequence = clock.next_input();
+        cs_packet.ack_tick = clock.last_tick();
+        cs_packet.x = enet_uint32(playa.position[0] * POS_SCALE);
+        cs_packet.y = enet_uint32(playa.position[2] * POS_SCALE);
         cs_packet.looking_at_x = playa.looking_at_x;
         cs_packet.looking_at_y = playa.looking_at_y;
 
-        memcpy(buf.get(), &cs_packet, sizeof(cs_packet));
+        WireWriter w(packet->data, packet->dataLength);
+        write_packet(w, cs_packet);
+        net->send(packet, CHANNEL_CONTROL);
+
         if(send_str)
         {
-            std::copy(typed_str.begin(), typed_str.end(), buf.get() + sizeof(cs_packet));
+            const size_t chat_length = std::min(typed_str.size(), MAX_CHAT_LINE_LEN_TXT);
+            net->send(enet_packet_create(typed_str.data(), chat_length, ENET_PACKET_FLAG_RELIABLE), CHANNEL_CHAT);
             typed_str.clear();
             send_str = false;
         }
 
-        auto send_packet(enet_packet_create(buf.get(), s, 0));
-        enet_peer_send(peer, 0, send_packet);
-        enet_host_flush(host.get());
-
         cs_packet.action = 0;
-
-        cs_packet.yaw = ENET_NET_TO_HOST_16(cs_packet.yaw);
-        cs_packet.pitch = ENET_NET_TO_HOST_16(cs_packet.pitch);
     }
 }
 
@@ -1550,6 +1710,16 @@ MineClient::State MineClient::get_state() const
     return current_state;
 }
 
+float MineClient::get_rtt() const
+{
+    return clock.rtt();
+}
+
+float MineClient::get_input_time() const
+{
+    return rates.input_time();
+}
+
 glm::mat4 MineClient::get_view_matrix()
 {
     const auto& self = players[my_player_id];
@@ -1579,6 +1749,43 @@ glm::mat4 MineClient::get_top_view_matrix()
 
 void MineClient::render_world()
 {
+    // changed tiles are flagged with 0x80. their chunks go stale and get redrawn on the minimap,
+    // and the rectangle around all of them goes up to board_tex in one upload
+    int min_x = width, min_y = height, max_x = -1, max_y = -1;
+    for(size_t c = 0; c < world_chunks.size(); ++c)
+    {
+        const auto& chunk = world_chunks[c];
+        bool changed = false;
+        for(int y = chunk.y; y < chunk.y + chunk.h; ++y)
+        {
+            for(int x = chunk.x; x < chunk.x + chunk.w; ++x)
+            {
+                auto& s = world[y * width + x];
+                if(!(s & 0x80)) continue;
+                s &= 0x7F;
+                changed = true;
+                min_x = std::min(min_x, x);
+                min_y = std::min(min_y, y);
+                max_x = std::max(max_x, x);
+                max_y = std::max(max_y, y);
+            }
+        }
+        if(changed)
+        {
+            stale_chunks[c] = true;
+            minimap_dirty_chunks.push_back(c);
+        }
+    }
+
+    if(max_x >= 0)
+    {
+        board_tex->update(min_x, min_y, max_x - min_x + 1, max_y - min_y + 1, world.data());
+    }
+}
+
+void MineClient::render_chunk(const size_t chunk_idx)
+{
+    const auto& chunk = world_chunks[chunk_idx];
     const float minX = 0.0f;
     const float minY = 0.0f;
     constexpr UVArr tl_flag_uv{0.25f + 0.125f, 1.0f, -0.125f, 0.25f};
@@ -1599,35 +1806,35 @@ void MineClient::render_world()
         {0.25f, 0.25f, 0.25f},
     };
 
-    int xi = 0;
-    int yi = 0;
-    int idx = 0;
-    auto lower_verts = lower_world_buf->getAllVerts();
-    auto upper_verts = upper_world_buf->getAllVerts();
+    auto lower_verts = lower_world_buf->getQuads(chunk.first_quad, chunk.w * chunk.h);
+    auto upper_verts = upper_world_buf->getQuads(chunk.first_quad, chunk.w * chunk.h);
 
-    for(auto& s : world)
+    // the whole chunk is rewritten, changed or not
+    size_t quad = chunk.first_quad;
+    for(int yi = chunk.y; yi < chunk.y + chunk.h; ++yi)
     {
-        if(s & 0x80)
+        for(int xi = chunk.x; xi < chunk.x + chunk.w; ++xi)
         {
-            s ^= 0x80;
+            const auto s = world[yi * width + xi];
             const float x_l = minX + xi;
             const float t_y = minY + yi + 1.0f;
 
-            const bool digit = s >= '1' && s <= '9';
+            // at most 8 neighbours, anything else a server sends isn't a number
+            const bool digit = s >= '1' && s <= '8';
 
-            const UVArr& arr = digit ? number_uvs_arr[s - '0'] : (s == 'f' ? tl_flag_uv : transparent_uvs);
+            const UVArr arr = digit ? Text::glyph_uvs(s) : (s == 'f' ? tl_flag_uv : transparent_uvs);
             const glm::vec4 color = digit ? glm::vec4(numbers_color[s - '1'], 1.0f) : solidWhite;
             const auto [l_u, t_v, delta_u, delta_v] = arr;
 
             const auto [lower_l_u, lower_t_v] = tl_lower_uvs[int(digit || s == ' ')];
 
             const PDD3 pos_upper{
-                {x_l, -1.0f + MyEpsilon, t_y},
+                {x_l, 0.0f, t_y},
                 {1, 0, 0},
                 {0.0f, 0.0f, 1.0f}
             };
             const PDD3 pos_lower{
-                {x_l, -1.0f, t_y},
+                {x_l, 0.0f, t_y},
                 {1, 0, 0},
                 {0.0f, 0.0f, 1.0f}
             };
@@ -1642,16 +1849,86 @@ void MineClient::render_world()
                 {0.0f, 0.25f}
             };
 
-            Fillers::fill_quad_generic(upper_verts, idx, pos_upper, upper_uv, color);
-            Fillers::fill_quad_generic(lower_verts, idx, pos_lower, lower_uv, solidWhite);
+            Fillers::fill_quad_generic(upper_verts, quad, pos_upper, upper_uv, color);
+            Fillers::fill_quad_generic(lower_verts, quad, pos_lower, lower_uv, solidWhite);
+            quad += 1;
+        }
+    }
+    stale_chunks[chunk_idx] = false;
+}
+
+void MineClient::render_minimap_board(RenderInfo& info)
+{
+    // straight down on the whole board, x and z going from 0 to width and height to -1 to 1
+    glm::mat4 board_to_frame(0.0f);
+    board_to_frame[0][0] = 2.0f / width;
+    board_to_frame[2][1] = 2.0f / height;
+    board_to_frame[3] = glm::vec4{-1.0f, -1.0f, 0.0f, 1.0f};
+
+    // only the changed chunks are redrawn, each one scissored to its own texels
+    minimap_board_frame->bind();
+    glEnable(GL_SCISSOR_TEST);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    info.flatProgram.model.set(board_to_frame);
+    for(const size_t c : minimap_dirty_chunks)
+    {
+        const auto& chunk = world_chunks[c];
+        glScissor(chunk.x * minimap_tile_texels, chunk.y * minimap_tile_texels, chunk.w * minimap_tile_texels, chunk.h * minimap_tile_texels);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        if(info.board_texture)
+        {
+            draw_board_floor(info.flatProgram, board_to_frame);
+        }
+        else
+        {
+            // flattened, so the tiles just go on top of the floor in draw order
+            lower_world_buf->bind();
+            lower_world_buf->drawQuads(chunk.first_quad, chunk.w * chunk.h);
+            upper_world_buf->bind();
+            upper_world_buf->drawQuads(chunk.first_quad, chunk.w * chunk.h);
         }
+    }
 
-        idx += 1;
-        xi += 1;
-        if(xi == width)
+    // the mip chain is the pyramid the minimap samples from, the level picked from its zoom, so
+    // zooming out doesn't alias and costs the same at every level. each level is only redrawn under
+    // the changed chunks, from the level above with linear filtering, which averages 2x2 texels
+    auto& board = minimap_board_frame->output();
+    board.bind();
+    info.flatProgram.model.set(board_to_frame);
+    floor_buf->bind();
+    for(int level = 1; level < minimap_board_frame->levels(); ++level)
+    {
+        board.sampleLevel(level - 1);
+        minimap_board_frame->bindLevel(level);
+        for(const size_t c : minimap_dirty_chunks)
         {
-            xi = 0;
-            yi += 1;
+            const auto& chunk = world_chunks[c];
+            const int x0 = (chunk.x * minimap_tile_texels) >> level;
+            const int y0 = (chunk.y * minimap_tile_texels) >> level;
+            const int x1 = ((chunk.x + chunk.w) * minimap_tile_texels + (1 << level) - 1) >> level;
+            const int y1 = ((chunk.y + chunk.h) * minimap_tile_texels + (1 << level) - 1) >> level;
+            glScissor(x0, y0, x1 - x0, y1 - y0);
+            floor_buf->draw();
         }
     }
+    board.sampleAllLevels();
+    info.spritesheet.bind();
+
+    glDisable(GL_SCISSOR_TEST);
+    minimap_dirty_chunks.clear();
+}
+
+void MineClient::draw_board_floor(const WorldProgram& program, const glm::mat4& model)
+{
+    glActiveTexture(GL_TEXTURE1);
+    board_tex->bind();
+    glActiveTexture(GL_TEXTURE0);
+
+    program.model.set(model);
+    program.boardMode.set(true);
+    program.boardSize.set(glm::ivec2(width, height));
+    floor_buf->bind();
+    floor_buf->draw();
+    program.boardMode.set(false);
 }
@@ -3,23 +3,84 @@
 #include "comms.h"
 #include "shader.h"
 #include "globjects.h"
+#include "skin_decoder.h"
+#include "client_net.h"
+#include "snapshots.h"
+#include "clock_sync.h"
+#include "text.h"
+#include "sprite_batch.h"
 
 #include <GLFW/glfw3.h>
 #include <vector>
 #include <array>
 #include <memory>
+#include <string>
+#include <map>
+#include <deque>
 #include <chrono>
 
+// the uniforms MineClient sets per draw on the world and flat programs, located once after linking
+struct WorldProgram {
+    explicit WorldProgram(const Shader& s)
+    :
+    shader(s),
+    model(s.uniform<glm::mat4>("model")),
+    constColor(s.uniform<glm::vec4>("constColor")),
+    boardMode(s.uniform<bool>("boardMode")),
+    boardSize(s.uniform<glm::ivec2>("boardSize"))
+    {
+
+    }
+
+    void use() const
+    {
+        shader.use();
+    }
+
+    const Shader& shader;
+    Uniform<glm::mat4> model;
+    Uniform<glm::vec4> constColor;
+    Uniform<bool> boardMode;
+    Uniform<glm::ivec2> boardSize;
+};
+
+// same for the instanced program, the model matrices come with the instances
+struct InstancedProgram {
+    explicit InstancedProgram(const Shader& s)
+    :
+    shader(s),
+    constColor(s.uniform<glm::vec4>("constColor")),
+    flatInstances(s.uniform<bool>("flatInstances"))
+    {
+
+    }
+
+    void use() const
+    {
+        shader.use();
+    }
+
+    const Shader& shader;
+    Uniform<glm::vec4> constColor;
+    Uniform<bool> flatInstances;
+};
+
 struct MineClient {
     struct RenderInfo {
-        Shader& worldShader;
-        Shader& flatShader;
+        const WorldProgram& worldProgram;
+        const WorldProgram& flatProgram;
+        // per-instance model matrix and color, for cursors and indicators
+        const InstancedProgram& instancedProgram;
+        // whole avatars posed from per-instance pitch and swing
+        Shader& avatarShader;
         Texture& spritesheet;
         const int display_w, display_h;
         const int crosshair_distance, crosshair_width, crosshair_length;
         const int minimap_scale;
         const int overlay_w, overlay_h;
         const float fov;
+        // the floor as one quad reading tile states from board_tex, instead of the tile buffers
+        const bool board_texture;
     };
 
     enum class State : unsigned char {
@@ -34,10 +95,12 @@ struct MineClient {
         Disconnected,
     };
 
-    MineClient(const char * server_addr, const char* skinpath, Texture& default_skin, const std::array<float, 4>& c_c, const char* un);
+    MineClient(const char * server_addr, const char* skinpath, const std::vector<unsigned char>& default_skin, const std::array<float, 4>& c_c, const char* un, bool spectate, const std::string& skin_cache);
 
-    void set_server_peer(ENetPeer* p);
-    void receive_packet(unsigned char* data, size_t length, std::vector<std::unique_ptr<char[]>>& out_chat);
+    // handles everything the network thread received since the last call
+    void poll_network(std::vector<std::unique_ptr<char[]>>& out_chat);
+    bool is_connected() const;
+    void receive_packet(const unsigned char* data, size_t length, enet_uint8 channel, std::vector<std::unique_ptr<char[]>>& out_chat);
     void disconnect(bool change_state);
     void cancel();
 
@@ -46,8 +109,11 @@ struct MineClient {
     void send();
 
     State get_state() const;
+    // smoothed round trip time in seconds, 0 until measured
+    float get_rtt() const;
+    // how often the server wants our input
+    float get_input_time() const;
 
-    ENetHostPtr host;
     // to receive every frame
     ServerWorldPacket sc_packet;
 
@@ -56,16 +122,39 @@ private:
     glm::mat4 get_view_matrix();
     glm::mat4 get_top_view_matrix();
     void render_world();
-
-    Texture& default_skin_tex;
+    void render_chunk(const size_t chunk_idx);
+    void draw_board_floor(const WorldProgram& program, const glm::mat4& model);
+    void render_minimap_board(RenderInfo& info);
+    void receive_player_joined(const unsigned char* data, size_t length);
+    void request_skins();
+    void receive_skin_chunk(const unsigned char* data, size_t length);
+    void receive_chat(const unsigned char* data, size_t length, std::vector<std::unique_ptr<char[]>>& out_chat);
+    void fill_chat(const std::vector<std::unique_ptr<char[]>>& lines);
+    void upload_skins();
+    void record_snapshots(enet_uint32 tick);
+    void interpolate_players();
+
+    // SKIN_SIZE square
+    const std::vector<unsigned char>& default_skin_pixels;
     Framebuffer minimap_frame, chat_frame;
+    UniformBuffer camera_buf;
     Buffer minimap_behind_buf, indicator_buf;
-    Buffer chat_buf, chat_visible_buf;
-    Buffer minimap_buf, overlay_buf, crosshair_buf, counters_buf, cursor_buf;
-    Buffer player_head_buf, player_body_buf, player_arm_left_buf, player_arm_right_buf, player_leg_left_buf, player_leg_right_buf;
-    Buffer player_helm_buf, player_coat_buf, player_sleeve_left_buf, player_sleeve_right_buf, player_pant_left_buf, player_pant_right_buf;
-    ENetPeer* peer;
-    ENetAddress address;
+    Buffer chat_buf, cursor_buf;
+    Buffer avatar_buf;
+    // everything drawn over the world once it's done
+    SpriteBatch hud;
+    // the overlay transform the counters were last laid out with
+    glm::mat4 counters_model;
+    // the overlay's counters, kept in hud's buffer
+    TextRun timer_text, bombs_text, flags_text;
+    // chat_buf's rows from the top down, then the line being typed
+    std::vector<TextRun> chat_rows;
+    TextRun typed_text;
+    // chat_frame is only composed again after chat_buf changed
+    bool chat_frame_dirty;
+    // reused every frame for whatever is drawn instanced next
+    std::vector<Instance> instances;
+    std::unique_ptr<ClientNet> net;
 
     // state
     State current_state;
@@ -74,8 +163,30 @@ private:
     bool first_mouse;
     float prevx, prevy;
     bool send_str;
+    // spectators follow a player (my_player_id) instead of controlling one
+    bool spectating;
     std::vector<unsigned char> skin_bytes;
 
+    // catch-up stream, and the snapshots that arrived while it was incomplete
+    std::vector<unsigned char> catchup_data;
+    size_t catchup_received;
+    // what came on the other channels before the catch-up was complete
+    struct QueuedPacket {
+        enet_uint8 channel;
+        std::vector<unsigned char> data;
+    };
+    std::vector<QueuedPacket> queued_packets;
+
+    // skins are fetched by hash and kept on disk, so they're only downloaded once
+    struct SkinDownload {
+        std::vector<unsigned char> data;
+        size_t received = 0; // chunks come in order, so it's also where the next one goes
+    };
+    std::string skin_cache_dir;
+    // one per skin requested and not complete yet
+    std::map<SkinHash, SkinDownload> skin_downloads;
+    SkinDecoder skin_decoder;
+
     // to send at connection
     std::array<float, 4> my_crosshair_color;
     const char* username;
@@ -84,9 +195,45 @@ private:
     unsigned char width, height;
     enet_uint16 total_bombs;
     std::vector<unsigned char> world;
-    std::unique_ptr<Buffer> wall_buf, lower_world_buf, upper_world_buf;
+    std::unique_ptr<Buffer> wall_buf, lower_world_buf, upper_world_buf, floor_buf;
+    // the tile buffers hold the board chunk after chunk, each one a range of quads
+    // that gets culled as a whole and rebuilt as a whole when one of its tiles changes
+    struct WorldChunk {
+        int x, y, w, h;
+        size_t first_quad;
+    };
+    static constexpr int CHUNK_SIZE = 16;
+    std::vector<WorldChunk> world_chunks;
+    // chunks changed since their quads were last written, the tile buffers are only rebuilt
+    // when they're drawn, so not at all while board_tex draws the floor
+    std::vector<bool> stale_chunks;
+    // wall quads, CHUNK_SIZE at most along one side
+    struct WallRun {
+        size_t first_quad, quads;
+        glm::vec3 min, max;
+    };
+    std::vector<WallRun> wall_runs;
+    // world as it is, one byte per tile
+    std::unique_ptr<ByteTexture> board_tex;
+    // the board as the minimap shows it, redrawn chunk by chunk as they change
+    std::unique_ptr<Framebuffer> minimap_board_frame;
+    int minimap_tile_texels;
+    std::vector<size_t> minimap_dirty_chunks;
     std::vector<PlayerData> players;
-    std::vector<std::unique_ptr<Texture>> skins;
+    std::vector<PlayerSnapshots> player_snapshots;
+    // player states of the last snapshots, which the next ones can be deltas against
+    struct ReceivedStates {
+        enet_uint32 tick;
+        std::vector<PackedPlayer> states;
+    };
+    static constexpr size_t RECEIVED_STATES_KEPT = 64; // twice what the server keeps
+    std::deque<ReceivedStates> received_states;
+    ServerClock clock;
+    ServerRates rates;
+    // player i's skin goes in layer i + 1 once decoded
+    std::unique_ptr<TextureArray> skin_array;
+    std::vector<bool> skin_uploaded;
+    std::vector<SkinHash> player_skins;
     std::vector<Buffer> player_names_buf;
     unsigned char my_player_id;
 
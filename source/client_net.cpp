@@ -0,0 +1,112 @@
+#include "client_net.h"
+
+ClientNet::ClientNet(const ENetAddress& address, enet_uint32 connect_data)
+:
+host(enet_host_create(nullptr, 1, CHANNEL_COUNT, 0, 0)),
+peer(enet_host_connect(host.get(), &address, CHANNEL_COUNT, connect_data)),
+peer_gone(false),
+stopping(false),
+thread(&ClientNet::run, this)
+{
+
+}
+
+ClientNet::~ClientNet()
+{
+    disconnect();
+}
+
+void ClientNet::send(ENetPacket* packet, enet_uint8 channel)
+{
+    // the net thread drains this every millisecond, so it's never full for long
+    while(!outgoing.try_push(OutgoingPacket{packet, channel}))
+    {
+        std::this_thread::yield();
+    }
+}
+
+bool ClientNet::poll(NetEvent& out)
+{
+    return incoming.try_pop(out);
+}
+
+void ClientNet::disconnect()
+{
+    if(!thread.joinable()) return;
+
+    stopping = true;
+    thread.join();
+
+    NetEvent event;
+    while(incoming.try_pop(event))
+    {
+        if(event.packet) enet_packet_destroy(event.packet);
+    }
+    OutgoingPacket out;
+    while(outgoing.try_pop(out))
+    {
+        enet_packet_destroy(out.packet);
+    }
+    host.reset();
+}
+
+void ClientNet::run()
+{
+    ENetEvent event;
+    while(!stopping)
+    {
+        OutgoingPacket out;
+        bool sent = false;
+        while(outgoing.try_pop(out))
+        {
+            enet_peer_send(peer, out.channel, out.packet);
+            sent = true;
+        }
+        if(sent) enet_host_flush(host.get());
+
+        // wait a little for the first event, then take everything that's already there
+        for(int timeout = 1; enet_host_service(host.get(), &event, timeout) > 0; timeout = 0)
+        {
+            if(event.type == ENET_EVENT_TYPE_DISCONNECT) peer_gone = true;
+            NetEvent ev{event.type, event.channelID, event.type == ENET_EVENT_TYPE_RECEIVE ? event.packet : nullptr};
+            while(!incoming.try_push(std::move(ev)))
+            {
+                if(stopping)
+                {
+                    if(ev.packet) enet_packet_destroy(ev.packet);
+                    break;
+                }
+                std::this_thread::yield();
+            }
+        }
+    }
+    shutdown();
+}
+
+void ClientNet::shutdown()
+{
+    // nobody left to say goodbye to, and nothing would answer within the second
+    if(peer_gone || peer->state == ENET_PEER_STATE_DISCONNECTED) return;
+
+    ENetEvent event;
+    bool done = false;
+
+    enet_peer_disconnect(peer, 0);
+    while(enet_host_service(host.get(), &event, 1000) > 0)
+    {
+        switch (event.type)
+        {
+        case ENET_EVENT_TYPE_RECEIVE:
+            enet_packet_destroy(event.packet);
+            break;
+        case ENET_EVENT_TYPE_DISCONNECT:
+            done = true;
+            break;
+        default:
+            break;
+        }
+        if(done) break;
+    }
+
+    if(!done) enet_peer_reset(peer);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "comms.h"
+#include "spsc_queue.h"
+
+#include <atomic>
+#ifdef __MINGW32__
+#include "mingw.thread.h"
+#else
+#include <thread>
+#endif
+
+struct NetEvent {
+    ENetEventType type = ENET_EVENT_TYPE_NONE;
+    enet_uint8 channel = 0;
+    ENetPacket* packet = nullptr;
+};
+
+// services the client's enet host on its own thread, so the render loop never blocks on the network.
+// packets are created on the main thread and handed over, received ones must be destroyed by the caller
+struct ClientNet {
+    ClientNet(const ENetAddress& address, enet_uint32 connect_data);
+    ~ClientNet();
+
+    void send(ENetPacket* packet, enet_uint8 channel);
+    bool poll(NetEvent& out);
+    // waits up to a second for the server to acknowledge, unless it already dropped us
+    void disconnect();
+
+private:
+    struct OutgoingPacket {
+        ENetPacket* packet = nullptr;
+        enet_uint8 channel = 0;
+    };
+
+    void run();
+    void shutdown();
+
+    ENetHostPtr host;
+    ENetPeer* peer;
+    // only touched on the net thread, set once the server has dropped the connection
+    bool peer_gone;
+    SpscQueue<NetEvent, 256> incoming;
+    SpscQueue<OutgoingPacket, 64> outgoing;
+    std::atomic<bool> stopping;
+    std::thread thread;
+};
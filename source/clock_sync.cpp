@@ -0,0 +1,106 @@
+#include "clock_sync.h"
+
+#include <algorithm>
+#include <cmath>
+
+ServerClock::ServerClock()
+:
+start(std::chrono::steady_clock::now()),
+rates(DEFAULT_RATES),
+offset(0.0f), spacing(DEFAULT_RATES.snapshot_time()), smoothed_rtt(0.0f),
+last_snapshot(-1.0f),
+newest_tick(0),
+sequence(0), acked(0),
+sent_at{}
+{
+
+}
+
+void ServerClock::set_rates(const ServerRates& server_rates)
+{
+    rates = server_rates;
+    spacing = rates.snapshot_time();
+}
+
+float ServerClock::local_now() const
+{
+    return std::chrono::duration<float>{std::chrono::steady_clock::now() - start}.count();
+}
+
+float ServerClock::server_now() const
+{
+    return local_now() + offset;
+}
+
+bool ServerClock::synced() const
+{
+    return last_snapshot >= 0.0f;
+}
+
+float ServerClock::rtt() const
+{
+    return smoothed_rtt;
+}
+
+float ServerClock::snapshot_spacing() const
+{
+    return spacing;
+}
+
+enet_uint32 ServerClock::last_tick() const
+{
+    return newest_tick;
+}
+
+float ServerClock::on_snapshot(enet_uint32 tick)
+{
+    const float server_time = tick * rates.tick_time();
+    // it took about half a round trip to get here
+    const float sample = server_time + (smoothed_rtt * 0.5f) - local_now();
+    if(!synced() || std::fabs(sample - offset) > 0.5f)
+    {
+        // first one, or too far off to smooth out
+        offset = sample;
+    }
+    else if(tick > newest_tick)
+    {
+        offset += (sample - offset) * 0.05f;
+        spacing += ((server_time - last_snapshot) - spacing) * 0.1f;
+    }
+
+    if(tick > newest_tick || !synced())
+    {
+        newest_tick = tick;
+        last_snapshot = server_time;
+    }
+    return server_time;
+}
+
+enet_uint32 ServerClock::next_input()
+{
+    sequence += 1;
+    sent_at[sequence % sent_at.size()] = local_now();
+    return sequence;
+}
+
+void ServerClock::on_input_acked(enet_uint32 sequence_low_bits)
+{
+    // the ack can only be for an input already sent, so it's the latest sequence with those low bits
+    const enet_uint32 mask = (1u << PLAYER_QUANTIZATION.sequence_bits) - 1;
+    const enet_uint32 acked_sequence = sequence - ((sequence - sequence_low_bits) & mask);
+
+    // only new acks, and only for inputs we still have the send time of
+    if(acked_sequence <= acked || acked_sequence > sequence || sequence - acked_sequence >= sent_at.size()) return;
+    acked = acked_sequence;
+
+    // the server applies inputs on its next update and acks them with the next snapshot, which averages half a snapshot later
+    const float sample = std::max(0.0f, local_now() - sent_at[acked_sequence % sent_at.size()] - (rates.snapshot_time() * 0.5f));
+    if(smoothed_rtt == 0.0f)
+    {
+        smoothed_rtt = sample;
+    }
+    else
+    {
+        smoothed_rtt += (sample - smoothed_rtt) * 0.125f;
+    }
+}
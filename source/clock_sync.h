@@ -0,0 +1,41 @@
+#pragma once
+
+#include "comms.h"
+
+#include <array>
+#include <chrono>
+
+// the client's estimate of the server clock and of the round trip time,
+// so snapshot timing, input acks and latency all use the same timebase
+struct ServerClock {
+    ServerClock();
+
+    // from the init packet, before any snapshot
+    void set_rates(const ServerRates& server_rates);
+
+    // seconds since this client started
+    float local_now() const;
+    // seconds since the server started, as it is there right now
+    float server_now() const;
+    bool synced() const;
+    float rtt() const;
+    float snapshot_spacing() const;
+    enet_uint32 last_tick() const;
+
+    // returns the server time the snapshot was taken at
+    float on_snapshot(enet_uint32 tick);
+    // sequence number to stamp the next input with
+    enet_uint32 next_input();
+    // only the low PLAYER_QUANTIZATION.sequence_bits of the sequence are sent
+    void on_input_acked(enet_uint32 sequence_low_bits);
+
+private:
+    std::chrono::steady_clock::time_point start;
+    ServerRates rates;
+    float offset, spacing, smoothed_rtt;
+    float last_snapshot;
+    enet_uint32 newest_tick;
+    enet_uint32 sequence, acked;
+    // when each of the recent inputs was sent, by sequence
+    std::array<float, 64> sent_at;
+};
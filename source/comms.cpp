@@ -1,5 +1,289 @@
 #include "comms.h"
+#include "sha256.h"
+#include <algorithm>
 #include <cstring>
+#include <cmath>
+
+SkinHash hash_skin(const unsigned char* data, const size_t length)
+{
+    // a player picks their skin's bytes, so the hash has to be one they can't collide with someone else's
+    const auto digest = sha256(data, length);
+    SkinHash out;
+    std::copy(digest.begin(), digest.begin() + out.size(), out.begin());
+    return out;
+}
+std::string skin_hash_to_string(const SkinHash& hash)
+{
+    constexpr char digits[] = "0123456789abcdef";
+    std::string out;
+    for(const auto b : hash)
+    {
+        out += digits[b >> 4];
+        out += digits[b & 0xF];
+    }
+    return out;
+}
+
+void write_packet(WireWriter& w, const ServerWorldPacketInit& p)
+{
+    w.u16(p.protocol_version);
+    w.u8(p.players);
+    w.u8(p.your_id);
+    w.u8(p.width);
+    w.u8(p.height);
+    w.u16(p.bombs);
+    w.u8(p.rates.tick_rate);
+    w.u8(p.rates.snapshot_rate);
+    w.u8(p.rates.input_rate);
+}
+void write_packet(WireWriter& w, const PlayerMetaPacket& p)
+{
+    w.bytes(p.username, MAX_NAME_LEN);
+    w.u8(p.cross_r);
+    w.u8(p.cross_g);
+    w.u8(p.cross_b);
+    w.u8(p.cross_a);
+    w.u32(p.skinbytes);
+}
+void write_packet(WireWriter& w, const ClientPlayerPacket& p)
+{
+    w.u32(p.sequence);
+    w.u32(p.ack_tick);
+    w.u32(p.x);
+    w.u32(p.y);
+    w.u16(p.yaw);
+    w.u16(p.pitch);
+    w.i8(p.looking_at_x);
+    w.i8(p.looking_at_y);
+    w.u8(p.action);
+}
+void write_packet(WireWriter& w, const ServerWorldPacket& p)
+{
+    w.u16(p.placed_flags);
+    w.i8(p.result);
+    w.u8(p.seconds);
+    w.u8(p.minutes);
+    w.u16(p.changed_tiles);
+    w.u32(p.tick);
+    w.u32(p.baseline_tick);
+}
+void write_packet(WireWriter& w, const TileChangePacket& p)
+{
+    w.u16(p.idx);
+    w.u8(p.tile);
+}
+void write_packet(WireWriter& w, const SpectatorWorldPacket& p)
+{
+    w.u8(CONTROL_SPECTATOR_SNAPSHOT);
+    w.u16(p.placed_flags);
+    w.i8(p.result);
+    w.u8(p.seconds);
+    w.u8(p.minutes);
+    w.u8(p.keyframe);
+    w.u16(p.changed_tiles);
+    w.u32(p.tick);
+}
+void write_packet(WireWriter& w, const StreamChunkPacket& p)
+{
+    w.u8(CONTROL_CATCHUP_CHUNK);
+    w.u32(p.total);
+    w.u32(p.offset);
+}
+void write_packet(WireWriter& w, const ServerPlayerPacket& p)
+{
+    w.u32(p.input_sequence);
+    w.u32(p.x);
+    w.u32(p.y);
+    w.u16(p.yaw);
+    w.u16(p.pitch);
+    w.i8(p.looking_at_x);
+    w.i8(p.looking_at_y);
+}
+void write_packet(WireWriter& w, const StartDataPacket& p)
+{
+    write_packet(w, p.info);
+    write_packet(w, p.meta);
+    write_packet(w, p.skin);
+}
+void write_packet(WireWriter& w, const PlayerJoinedPacket& p)
+{
+    w.u8(CONTROL_PLAYER_JOINED);
+    w.u8(p.player);
+    write_packet(w, p.meta);
+    write_packet(w, p.skin);
+}
+void write_packet(WireWriter& w, const SkinChunkPacket& p)
+{
+    write_packet(w, p.skin);
+    w.u32(p.total);
+    w.u32(p.offset);
+}
+void write_packet(WireWriter& w, const SkinHash& p)
+{
+    w.bytes(p.data(), p.size());
+}
+void write_packet(WireWriter& w, const ChatBatchPacket& p)
+{
+    w.u8(p.count);
+}
+void write_packet(WireWriter& w, const ChatLinePacket& p)
+{
+    w.u8(p.player);
+    w.u8(p.length);
+}
+
+bool read_packet(WireReader& r, ServerWorldPacketInit& p)
+{
+    p.protocol_version = r.u16();
+    p.players = r.u8();
+    p.your_id = r.u8();
+    p.width = r.u8();
+    p.height = r.u8();
+    p.bombs = r.u16();
+    p.rates.tick_rate = r.u8();
+    p.rates.snapshot_rate = r.u8();
+    p.rates.input_rate = r.u8();
+    return r.ok();
+}
+bool read_packet(WireReader& r, PlayerMetaPacket& p)
+{
+    const auto username = r.bytes(MAX_NAME_LEN);
+    if(username) memcpy(p.username, username, MAX_NAME_LEN);
+    p.cross_r = r.u8();
+    p.cross_g = r.u8();
+    p.cross_b = r.u8();
+    p.cross_a = r.u8();
+    p.skinbytes = r.u32();
+    return r.ok();
+}
+bool read_packet(WireReader& r, ClientPlayerPacket& p)
+{
+    p.sequence = r.u32();
+    p.ack_tick = r.u32();
+    p.x = r.u32();
+    p.y = r.u32();
+    p.yaw = r.u16();
+    p.pitch = r.u16();
+    p.looking_at_x = r.i8();
+    p.looking_at_y = r.i8();
+    p.action = r.u8();
+    return r.ok();
+}
+bool read_packet(WireReader& r, ServerWorldPacket& p)
+{
+    p.placed_flags = r.u16();
+    p.result = r.i8();
+    p.seconds = r.u8();
+    p.minutes = r.u8();
+    p.changed_tiles = r.u16();
+    p.tick = r.u32();
+    p.baseline_tick = r.u32();
+    return r.ok();
+}
+bool read_packet(WireReader& r, TileChangePacket& p)
+{
+    p.idx = r.u16();
+    p.tile = r.u8();
+    return r.ok();
+}
+bool read_packet(WireReader& r, SpectatorWorldPacket& p)
+{
+    const bool kind = r.u8() == CONTROL_SPECTATOR_SNAPSHOT;
+    p.placed_flags = r.u16();
+    p.result = r.i8();
+    p.seconds = r.u8();
+    p.minutes = r.u8();
+    p.keyframe = r.u8();
+    p.changed_tiles = r.u16();
+    p.tick = r.u32();
+    return kind && r.ok();
+}
+bool read_packet(WireReader& r, StreamChunkPacket& p)
+{
+    const bool kind = r.u8() == CONTROL_CATCHUP_CHUNK;
+    p.total = r.u32();
+    p.offset = r.u32();
+    return kind && r.ok();
+}
+bool read_packet(WireReader& r, ServerPlayerPacket& p)
+{
+    p.input_sequence = r.u32();
+    p.x = r.u32();
+    p.y = r.u32();
+    p.yaw = r.u16();
+    p.pitch = r.u16();
+    p.looking_at_x = r.i8();
+    p.looking_at_y = r.i8();
+    return r.ok();
+}
+bool read_packet(WireReader& r, StartDataPacket& p)
+{
+    read_packet(r, p.info);
+    read_packet(r, p.meta);
+    return read_packet(r, p.skin);
+}
+bool read_packet(WireReader& r, PlayerJoinedPacket& p)
+{
+    const bool kind = r.u8() == CONTROL_PLAYER_JOINED;
+    p.player = r.u8();
+    read_packet(r, p.meta);
+    read_packet(r, p.skin);
+    return kind && r.ok();
+}
+bool read_packet(WireReader& r, SkinChunkPacket& p)
+{
+    read_packet(r, p.skin);
+    p.total = r.u32();
+    p.offset = r.u32();
+    return r.ok();
+}
+bool read_packet(WireReader& r, SkinHash& p)
+{
+    const auto hash = r.bytes(p.size());
+    if(hash) memcpy(p.data(), hash, p.size());
+    return r.ok();
+}
+bool read_packet(WireReader& r, ChatBatchPacket& p)
+{
+    p.count = r.u8();
+    return r.ok();
+}
+bool read_packet(WireReader& r, ChatLinePacket& p)
+{
+    p.player = r.u8();
+    p.length = r.u8();
+    return r.ok();
+}
+
+void compress_tiles(const unsigned char* tiles, const size_t count, std::vector<unsigned char>& out)
+{
+    size_t i = 0;
+    while(i < count)
+    {
+        const unsigned char tile = tiles[i];
+        unsigned char run = 1;
+        while(i + run < count && run < 255 && tiles[i + run] == tile)
+        {
+            run += 1;
+        }
+        out.push_back(run);
+        out.push_back(tile);
+        i += run;
+    }
+}
+bool decompress_tiles(const unsigned char* data, const size_t length, unsigned char* tiles, const size_t count)
+{
+    size_t i = 0;
+    for(size_t offset = 0; offset + 1 < length; offset += 2)
+    {
+        const size_t run = data[offset];
+        if(i + run > count) return false;
+
+        memset(tiles + i, data[offset + 1], run);
+        i += run;
+    }
+    return i == count;
+}
 
 
 void PlayerData::fill(const PlayerMetaPacket& p)
@@ -14,23 +298,18 @@ void PlayerData::fill(const PlayerMetaPacket& p)
 }
 void PlayerData::fill(const ServerPlayerPacket& p)
 {
+    input_sequence = p.input_sequence;
     looking_at_x = p.looking_at_x;
     looking_at_y = p.looking_at_y;
 
     const auto oldPos = position;
-    position[0] = ENET_NET_TO_HOST_32(p.x) / POS_SCALE;
-    position[2] = ENET_NET_TO_HOST_32(p.y) / POS_SCALE;
+    position[0] = p.x / POS_SCALE;
+    position[2] = p.y / POS_SCALE;
     movedDistance = glm::distance(position, oldPos);
 
-    const auto yaw_bytes = ENET_NET_TO_HOST_16(p.yaw);
-    int16_t yaw_int = 0;
-    memcpy(&yaw_int, &yaw_bytes, sizeof(int16_t));
-    yaw = yaw_int;
-
-    const auto pitch_bytes = ENET_NET_TO_HOST_16(p.pitch);
-    int16_t pitch_int = 0;
-    memcpy(&pitch_int, &pitch_bytes, sizeof(int16_t));
-    pitch = pitch_int;
+    // the angles are signed, sent as their two's complement
+    yaw = int16_t(p.yaw);
+    pitch = int16_t(p.pitch);
 }
 
 PlayerMetaPacket PlayerData::fill_meta() const
@@ -46,18 +325,135 @@ PlayerMetaPacket PlayerData::fill_meta() const
 ServerPlayerPacket PlayerData::fill_info() const
 {
     ServerPlayerPacket out;
-    out.x = ENET_HOST_TO_NET_32(enet_uint32(position[0] * POS_SCALE));
-    out.y = ENET_HOST_TO_NET_32(enet_uint32(position[2] * POS_SCALE));
-
-    enet_uint16 yaw_bytes = 0;
-    memcpy(&yaw_bytes, &yaw, sizeof(int16_t));
-    out.yaw = ENET_HOST_TO_NET_16(yaw_bytes);
-
-    enet_uint16 pitch_bytes = 0;
-    memcpy(&pitch_bytes, &pitch, sizeof(int16_t));
-    out.pitch = ENET_HOST_TO_NET_16(pitch_bytes);
-
+    out.input_sequence = input_sequence;
+    out.x = enet_uint32(position[0] * POS_SCALE);
+    out.y = enet_uint32(position[2] * POS_SCALE);
+    out.yaw = enet_uint16(yaw);
+    out.pitch = enet_uint16(pitch);
     out.looking_at_x = looking_at_x;
     out.looking_at_y = looking_at_y;
     return out;
 }
+namespace {
+    size_t full_player_bits(const PlayerQuantization& q)
+    {
+        return q.sequence_bits + (q.position_bits * 2) + q.yaw_bits + q.pitch_bits + (LOOKING_AT_BITS * 2);
+    }
+}
+
+size_t packed_players_size(size_t players, const PlayerQuantization& q)
+{
+    // a changed bit, then one per group of fields
+    const size_t bits = 1 + 4 + full_player_bits(q);
+    return ((players * bits) + 7) / 8;
+}
+
+void write_packed_player(BitWriter& w, const PackedPlayer& p, const PackedPlayer* baseline, const PlayerQuantization& q)
+{
+    const bool sequence_changed = !baseline || p.sequence != baseline->sequence;
+    const bool position_changed = !baseline || p.x != baseline->x || p.z != baseline->z;
+    const bool angles_changed = !baseline || p.yaw != baseline->yaw || p.pitch != baseline->pitch;
+    const bool looking_changed = !baseline || p.looking_at_x != baseline->looking_at_x || p.looking_at_y != baseline->looking_at_y;
+    if(baseline)
+    {
+        const bool changed = sequence_changed || position_changed || angles_changed || looking_changed;
+        w.write(changed, 1);
+        if(!changed) return;
+
+        if(q.sequence_bits) w.write(sequence_changed, 1);
+        w.write(position_changed, 1);
+        w.write(angles_changed, 1);
+        w.write(looking_changed, 1);
+    }
+
+    if(q.sequence_bits && sequence_changed)
+    {
+        w.write(p.sequence, q.sequence_bits);
+    }
+    if(position_changed)
+    {
+        w.write(p.x, q.position_bits);
+        w.write(p.z, q.position_bits);
+    }
+    if(angles_changed)
+    {
+        w.write(p.yaw, q.yaw_bits);
+        w.write(p.pitch, q.pitch_bits);
+    }
+    if(looking_changed)
+    {
+        w.write(p.looking_at_x, LOOKING_AT_BITS);
+        w.write(p.looking_at_y, LOOKING_AT_BITS);
+    }
+}
+
+PackedPlayer read_packed_player(BitReader& r, const PackedPlayer* baseline, const PlayerQuantization& q)
+{
+    PackedPlayer p = baseline ? *baseline : PackedPlayer{};
+    bool sequence_changed = true, position_changed = true, angles_changed = true, looking_changed = true;
+    if(baseline)
+    {
+        if(!r.read(1)) return p;
+
+        sequence_changed = q.sequence_bits && r.read(1);
+        position_changed = r.read(1);
+        angles_changed = r.read(1);
+        looking_changed = r.read(1);
+    }
+
+    if(q.sequence_bits && sequence_changed)
+    {
+        p.sequence = r.read(q.sequence_bits);
+    }
+    if(position_changed)
+    {
+        p.x = r.read(q.position_bits);
+        p.z = r.read(q.position_bits);
+    }
+    if(angles_changed)
+    {
+        p.yaw = r.read(q.yaw_bits);
+        p.pitch = r.read(q.pitch_bits);
+    }
+    if(looking_changed)
+    {
+        p.looking_at_x = r.read(LOOKING_AT_BITS);
+        p.looking_at_y = r.read(LOOKING_AT_BITS);
+    }
+    return p;
+}
+
+PackedPlayer PlayerData::pack(const PlayerQuantization& q, int width, int height) const
+{
+    PackedPlayer p;
+    p.sequence = q.sequence_bits ? input_sequence & ((1u << q.sequence_bits) - 1) : 0;
+    p.x = quantize(position[0], 0.0f, width, q.position_bits);
+    p.z = quantize(position[2], 0.0f, height, q.position_bits);
+
+    // yaw wraps around, so it uses all the steps of a full turn
+    const float turn = float(1u << q.yaw_bits);
+    const int wrapped_yaw = ((yaw % 360) + 360) % 360;
+    p.yaw = uint32_t(std::lround(wrapped_yaw * turn / 360.0f)) & ((1u << q.yaw_bits) - 1);
+    p.pitch = quantize(pitch, -90.0f, 90.0f, q.pitch_bits);
+
+    p.looking_at_x = uint32_t(looking_at_x + 1);
+    p.looking_at_y = uint32_t(looking_at_y + 1);
+    return p;
+}
+
+void PlayerData::unpack(const PackedPlayer& p, const PlayerQuantization& q, int width, int height)
+{
+    if(q.sequence_bits) input_sequence = p.sequence;
+
+    const auto oldPos = position;
+    position[0] = dequantize(p.x, 0.0f, width, q.position_bits);
+    position[2] = dequantize(p.z, 0.0f, height, q.position_bits);
+    movedDistance = glm::distance(position, oldPos);
+
+    const float turn = float(1u << q.yaw_bits);
+    yaw = int16_t(std::lround(p.yaw * 360.0f / turn));
+    pitch = int16_t(std::lround(dequantize(p.pitch, -90.0f, 90.0f, q.pitch_bits)));
+
+    looking_at_x = int(p.looking_at_x) - 1;
+    looking_at_y = int(p.looking_at_y) - 1;
+}
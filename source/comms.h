@@ -1,16 +1,30 @@
 #pragma once
 
 #include <memory>
+#include <vector>
+#include <array>
+#include <string>
 #include <cstdint>
 #include <enet/enet.h>
 #include <glm/glm.hpp>
 
+#include "bitpack.h"
+#include "wire.h"
+
 #define mymax(a, b) ((a) > (b) ? (a) : (b))
 
 inline constexpr enet_uint16 COMMS_PORT = 37777;
+inline constexpr enet_uint8 CHANNEL_CONTROL = 0; // handshake, catch-up stream, spectator snapshots
+inline constexpr enet_uint8 CHANNEL_WORLD = 1; // player snapshots
+inline constexpr enet_uint8 CHANNEL_SKINS = 2; // skin requests and transfers
+inline constexpr enet_uint8 CHANNEL_CHAT = 3; // typed lines one way, batches of them back
+inline constexpr size_t CHANNEL_COUNT = 4;
+inline constexpr enet_uint32 CONNECT_AS_PLAYER = 0;
+inline constexpr enet_uint32 CONNECT_AS_SPECTATOR = 1;
+// bumped whenever a packet layout changes, peers on another version are refused
+inline constexpr enet_uint16 PROTOCOL_VERSION = 4;
+inline constexpr unsigned char SPECTATOR_ID = 0xFF;
 inline constexpr float POS_SCALE = 10000.0f;
-inline constexpr int TICKS_PER_SEC = 25;
-inline constexpr float TIME_PER_TICK = 1.0f/TICKS_PER_SEC;
 inline constexpr float MovementSpeed = 2.0f;
 inline constexpr float MaxSwingAmplitude = 45.0f; // max degrees
 inline constexpr float SecondsPerSwing = 0.25f;
@@ -18,6 +32,9 @@ inline constexpr float SwingSpeed = MaxSwingAmplitude/SecondsPerSwing;
 inline constexpr size_t MAX_NAME_LEN = 32;
 inline constexpr size_t MAX_CHAT_LINE_LEN_TXT = 32;
 inline constexpr size_t MAX_CHAT_LINE_LEN = mymax(MAX_CHAT_LINE_LEN_TXT, MAX_NAME_LEN);
+inline constexpr size_t CATCHUP_CHUNK_SIZE = 4096;
+inline constexpr size_t CATCHUP_BYTES_PER_SEC = 50 * CATCHUP_CHUNK_SIZE;
+inline constexpr size_t MAX_SKIN_BYTES = 32 * 1024;
 
 #undef mymax
 
@@ -37,49 +54,247 @@ struct ENetPacketDeleter {
 };
 using ENetPacketPtr = std::unique_ptr<ENetPacket, ENetPacketDeleter>;
 
+// the connect data holds the role in its low byte and the PROTOCOL_VERSION above it
+inline constexpr enet_uint32 make_connect_data(enet_uint32 role)
+{
+    return role | (enet_uint32(PROTOCOL_VERSION) << 8);
+}
+inline constexpr enet_uint32 connect_role(enet_uint32 connect_data)
+{
+    return connect_data & 0xFF;
+}
+inline constexpr enet_uint32 connect_version(enet_uint32 connect_data)
+{
+    return connect_data >> 8;
+}
+
+// packets below are kept in host byte order in memory and only go through the wire as laid out by
+// write_packet and read_packet, WIRE_SIZE being the exact encoded size of each.
+// reads fail on truncated packets, and callers reject anything longer than what they expect
+
+// skins are identified by their PNG bytes' SHA-256, cut to 128 bits, all zeroes meaning no skin
+using SkinHash = std::array<unsigned char, 16>;
+SkinHash hash_skin(const unsigned char* data, const size_t length);
+std::string skin_hash_to_string(const SkinHash& hash);
+
 // on connection, server send this
+// how often the server updates the world, sends snapshots and wants inputs, all per second
+struct ServerRates {
+    unsigned char tick_rate, snapshot_rate, input_rate;
+
+    float tick_time() const
+    {
+        return 1.0f / tick_rate;
+    }
+    float snapshot_time() const
+    {
+        return 1.0f / snapshot_rate;
+    }
+    float input_time() const
+    {
+        return 1.0f / input_rate;
+    }
+};
+inline constexpr ServerRates DEFAULT_RATES{25, 12, 12};
+
 struct ServerWorldPacketInit {
+    enet_uint16 protocol_version; // first, so a client on another version can tell
     unsigned char players, your_id;
     unsigned char width, height;
     enet_uint16 bombs;
+    ServerRates rates;
+
+    static constexpr size_t WIRE_SIZE = 2 + 4 + 2 + 3;
 };
 // and player sends back this
 struct PlayerMetaPacket {
     char username[MAX_NAME_LEN];
     unsigned char cross_r, cross_g, cross_b, cross_a;
     enet_uint32 skinbytes;
+
+    static constexpr size_t WIRE_SIZE = MAX_NAME_LEN + 4 + 4;
 };
+// followed by the skinbytes of the skin
 // --------------------------------------
 
 // every tick, player sends this
 struct ClientPlayerPacket {
+    enet_uint32 sequence; // counts up with every input sent
+    enet_uint32 ack_tick; // newest server tick the client has
     enet_uint32 x, y;
     enet_uint16 yaw, pitch;
     signed char looking_at_x, looking_at_y;
     unsigned char action;
+
+    static constexpr size_t WIRE_SIZE = 4 + 4 + 4 + 4 + 2 + 2 + 1 + 1 + 1;
 };
 // and server sends back this
 struct ServerWorldPacket {
     enet_uint16 placed_flags;
     signed char result;
     unsigned char seconds, minutes;
+    enet_uint16 changed_tiles;
+    enet_uint32 tick; // server update this was sent on, to time the snapshots
+    enet_uint32 baseline_tick; // snapshot the player states are relative to, one the client acked
+
+    static constexpr size_t WIRE_SIZE = 2 + 1 + 1 + 1 + 2 + 4 + 4;
+};
+// followed by NUM_PLAYERS bit-packed player states (write_packed_player with PLAYER_QUANTIZATION),
+// as deltas against the states of baseline_tick unless it's 0, padded to a byte
+// followed by changed_tiles of these
+struct TileChangePacket {
+    enet_uint16 idx;
+    unsigned char tile;
+
+    static constexpr size_t WIRE_SIZE = 2 + 1;
+};
+// --------------------------------------
+
+// after the init packet, everything the server sends on CHANNEL_CONTROL starts with which one it is.
+// write_packet writes it and read_packet fails on any other
+inline constexpr unsigned char CONTROL_CATCHUP_CHUNK = 0;
+inline constexpr unsigned char CONTROL_SPECTATOR_SNAPSHOT = 1;
+inline constexpr unsigned char CONTROL_PLAYER_JOINED = 2;
+inline unsigned char control_kind(const unsigned char* data, size_t length)
+{
+    return length ? data[0] : 0xFF;
+}
+
+// spectators get this instead, every few ticks
+struct SpectatorWorldPacket {
+    enet_uint16 placed_flags;
+    signed char result;
+    unsigned char seconds, minutes;
+    unsigned char keyframe;
+    enet_uint16 changed_tiles;
+    enet_uint32 tick;
+
+    static constexpr size_t WIRE_SIZE = 1 + 2 + 1 + 1 + 1 + 1 + 2 + 4;
+};
+// followed by NUM_PLAYERS bit-packed player states with SPECTATOR_QUANTIZATION, padded to a byte
+// followed by the whole terrain if keyframe, otherwise changed_tiles of TileChangePacket
+// --------------------------------------
+
+// when everyone joined, or when someone joins during the game, server streams
+// the catch-up state to them in chunks over several ticks
+struct StreamChunkPacket {
+    enet_uint32 total, offset;
+
+    static constexpr size_t WIRE_SIZE = 1 + 4 + 4;
 };
-// followed by NUM_PLAYERS of these
+// followed by at most CATCHUP_CHUNK_SIZE bytes of the stream, which once put back together is
+// NUM_PLAYERS of this
+// full precision, only sent in the catch-up
 struct ServerPlayerPacket {
+    enet_uint32 input_sequence; // last input of this player the server applied
     enet_uint32 x, y;
     enet_uint16 yaw, pitch;
     signed char looking_at_x, looking_at_y;
-};
-// followed by terrain data
-// --------------------------------------
 
-// when everyone joined, server sends NUM_PLAYERS of this
+    static constexpr size_t WIRE_SIZE = 4 + 4 + 4 + 2 + 2 + 1 + 1;
+};
 struct StartDataPacket {
     ServerPlayerPacket info;
     PlayerMetaPacket meta;
+    SkinHash skin;
+
+    static constexpr size_t WIRE_SIZE = ServerPlayerPacket::WIRE_SIZE + PlayerMetaPacket::WIRE_SIZE + std::tuple_size<SkinHash>::value;
+};
+// followed by the compressed terrain until the end of the stream
+// --------------------------------------
+
+// when someone takes a slot during the game, everyone else is told who they are now
+struct PlayerJoinedPacket {
+    unsigned char player;
+    PlayerMetaPacket meta; // skinbytes only says whether there's a skin
+    SkinHash skin;
+
+    static constexpr size_t WIRE_SIZE = 1 + 1 + PlayerMetaPacket::WIRE_SIZE + std::tuple_size<SkinHash>::value;
+};
+// --------------------------------------
+
+// once caught up, clients ask for the skins missing from their cache with a list of SkinHash
+// and the server sends each of them back in chunks
+struct SkinChunkPacket {
+    SkinHash skin;
+    enet_uint32 total, offset;
+
+    static constexpr size_t WIRE_SIZE = std::tuple_size<SkinHash>::value + 4 + 4;
+};
+// followed by at most CATCHUP_CHUNK_SIZE bytes of the skin
+// --------------------------------------
+
+// players send each line they type on its own, at most MAX_CHAT_LINE_LEN_TXT bytes,
+// and the server sends everyone the lines said since its last update at once
+struct ChatBatchPacket {
+    unsigned char count;
+
+    static constexpr size_t WIRE_SIZE = 1;
+};
+// followed by count of these, each followed by its length bytes of text
+struct ChatLinePacket {
+    unsigned char player;
+    unsigned char length;
+
+    static constexpr size_t WIRE_SIZE = 1 + 1;
 };
 // --------------------------------------
 
+void write_packet(WireWriter& w, const ServerWorldPacketInit& p);
+void write_packet(WireWriter& w, const PlayerMetaPacket& p);
+void write_packet(WireWriter& w, const ClientPlayerPacket& p);
+void write_packet(WireWriter& w, const ServerWorldPacket& p);
+void write_packet(WireWriter& w, const TileChangePacket& p);
+void write_packet(WireWriter& w, const SpectatorWorldPacket& p);
+void write_packet(WireWriter& w, const StreamChunkPacket& p);
+void write_packet(WireWriter& w, const ServerPlayerPacket& p);
+void write_packet(WireWriter& w, const StartDataPacket& p);
+void write_packet(WireWriter& w, const PlayerJoinedPacket& p);
+void write_packet(WireWriter& w, const SkinChunkPacket& p);
+void write_packet(WireWriter& w, const SkinHash& p);
+void write_packet(WireWriter& w, const ChatBatchPacket& p);
+void write_packet(WireWriter& w, const ChatLinePacket& p);
+bool read_packet(WireReader& r, ServerWorldPacketInit& p);
+bool read_packet(WireReader& r, PlayerMetaPacket& p);
+bool read_packet(WireReader& r, ClientPlayerPacket& p);
+bool read_packet(WireReader& r, ServerWorldPacket& p);
+bool read_packet(WireReader& r, TileChangePacket& p);
+bool read_packet(WireReader& r, SpectatorWorldPacket& p);
+bool read_packet(WireReader& r, StreamChunkPacket& p);
+bool read_packet(WireReader& r, ServerPlayerPacket& p);
+bool read_packet(WireReader& r, StartDataPacket& p);
+bool read_packet(WireReader& r, PlayerJoinedPacket& p);
+bool read_packet(WireReader& r, SkinChunkPacket& p);
+bool read_packet(WireReader& r, SkinHash& p);
+bool read_packet(WireReader& r, ChatBatchPacket& p);
+bool read_packet(WireReader& r, ChatLinePacket& p);
+
+// run-length encoding of the terrain, as (run length, tile) pairs
+void compress_tiles(const unsigned char* tiles, const size_t count, std::vector<unsigned char>& out);
+bool decompress_tiles(const unsigned char* data, const size_t length, unsigned char* tiles, const size_t count);
+
+// how finely player states are packed in snapshots, positions are relative to the board size
+struct PlayerQuantization {
+    unsigned sequence_bits; // low bits of the last applied input, 0 leaves it out
+    unsigned position_bits;
+    unsigned yaw_bits;
+    unsigned pitch_bits;
+};
+inline constexpr PlayerQuantization PLAYER_QUANTIZATION{16, 16, 9, 8};
+inline constexpr PlayerQuantization SPECTATOR_QUANTIZATION{0, 12, 8, 7};
+inline constexpr unsigned LOOKING_AT_BITS = 7; // -1 or a tile coordinate, offset by one
+
+// quantized player state, what deltas are taken on
+struct PackedPlayer {
+    uint32_t sequence, x, z, yaw, pitch, looking_at_x, looking_at_y;
+};
+
+// with a baseline, an unchanged player is a single bit, otherwise a bit per group of fields says which follow
+void write_packed_player(BitWriter& w, const PackedPlayer& p, const PackedPlayer* baseline, const PlayerQuantization& q);
+PackedPlayer read_packed_player(BitReader& r, const PackedPlayer* baseline, const PlayerQuantization& q);
+// enough for every player, with or without a baseline
+size_t packed_players_size(size_t players, const PlayerQuantization& q);
+
 struct PlayerData {
     glm::vec3 position{0.0f, 0.0f, 0.0f}; // x0z
     float movedDistance = 0.0f;
@@ -87,6 +302,7 @@ struct PlayerData {
     float currentSwingDirection = SwingSpeed;
     int16_t yaw, pitch;
     signed char looking_at_x, looking_at_y; // y is when looking from sky, z in 3d space
+    enet_uint32 input_sequence = 0;
     glm::vec4 color;
     char username[MAX_NAME_LEN];
 
@@ -94,4 +310,7 @@ struct PlayerData {
     void fill(const ServerPlayerPacket& p);
     PlayerMetaPacket fill_meta() const;
     ServerPlayerPacket fill_info() const;
+    PackedPlayer pack(const PlayerQuantization& q, int width, int height) const;
+    // input_sequence only gets the low sequence_bits
+    void unpack(const PackedPlayer& p, const PlayerQuantization& q, int width, int height);
 };
@@ -4,38 +4,35 @@ void Fillers::fill_quad_generic(VertexPtr& verts, const size_t idx, const PDD3 p
 {
     // A B
     // C D
-    const Vertex vA{
+    const Vertex vA = Vertex::pack(
         pos.p,
         uv.p,
         color
-    };
-    const Vertex vB{
+    );
+    const Vertex vB = Vertex::pack(
         pos.p + pos.dr,
         uv.p + uv.dr,
         color
-    };
-    const Vertex vC{
+    );
+    const Vertex vC = Vertex::pack(
         pos.p - pos.dd,
         uv.p - uv.dd,
         color
-    };
-    const Vertex vD{
+    );
+    const Vertex vD = Vertex::pack(
         pos.p + pos.dr - pos.dd,
         uv.p + uv.dr - uv.dd,
         color
-    };
+    );
 
-    verts[mkidx(0, false, idx)] = vA;
-    verts[mkidx(1, false, idx)] = vB;
-    verts[mkidx(2, false, idx)] = vD;
-
-    verts[mkidx(0, true, idx)] = vC;
-    verts[mkidx(1, true, idx)] = vA;
-    verts[mkidx(2, true, idx)] = vD;
+    // the shared index buffer makes the two triangles out of them
+    verts[mkidx(0, idx)] = vA;
+    verts[mkidx(1, idx)] = vB;
+    verts[mkidx(2, idx)] = vC;
+    verts[mkidx(3, idx)] = vD;
 }
 
-int Fillers::mkidx(int vert_idx, int sechalf, int quad_idx)
+int Fillers::mkidx(int vert_idx, int quad_idx)
 {
-    static constexpr int half[2] = {0, 3};
-    return vert_idx + half[sechalf] + (quad_idx * 6);
+    return vert_idx + (quad_idx * VERTS_PER_QUAD);
 }
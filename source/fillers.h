@@ -14,5 +14,5 @@ using PDD2 = PositionDeltaDelta<glm::vec2>;
 
 namespace Fillers {
     void fill_quad_generic(VertexPtr& verts, const size_t idx, const PDD3 pos, const PDD2 uv, const glm::vec4 color);
-    int mkidx(int vert_idx, int sechalf, int quad_idx);
+    int mkidx(int vert_idx, int quad_idx);
 }
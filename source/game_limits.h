@@ -6,11 +6,21 @@ namespace Limits {
         constexpr int BombPercent = 10;
         constexpr int Width = 10;
         constexpr int Height = 10;
+        constexpr int Spectators = 0;
+        constexpr int SpectatorRate = 1;
+        constexpr int TickRate = 10;
+        constexpr int SnapshotRate = 5;
+        constexpr int InputRate = 5;
     }
     namespace Max {
         constexpr int Players = 6;
         constexpr int BombPercent = 40;
         constexpr int Width = 99;
         constexpr int Height = 99;
+        constexpr int Spectators = 128;
+        constexpr int SpectatorRate = 12;
+        constexpr int TickRate = 60;
+        constexpr int SnapshotRate = 60;
+        constexpr int InputRate = 60;
     }
 }
\ No newline at end of file
@@ -1,16 +1,50 @@
 #include "globjects.h"
 
 #include <tuple>
+#include <vector>
+#include <algorithm>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
-VertexPtr::VertexPtr(const unsigned v, const size_t cnt) : VBO(v), count(cnt)
+namespace {
+    // every quad buffer shares these indices, only ever grown
+    unsigned quad_indices = 0;
+    size_t quad_indices_count = 0;
+
+    // binds them to the current VAO, with room for at least that many quads
+    void bind_quad_indices(const size_t quads)
+    {
+        if(quad_indices == 0)
+        {
+            glGenBuffers(1, &quad_indices);
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quad_indices);
+        if(quads <= quad_indices_count) return;
+
+        // same winding as the two triangles fill_quad_generic used to write: A B D, C A D
+        const size_t count = std::max(quads, quad_indices_count * 2);
+        std::vector<unsigned> indices(count * INDICES_PER_QUAD);
+        for(size_t q = 0; q < count; ++q)
+        {
+            const unsigned base = q * VERTS_PER_QUAD;
+            const unsigned quad[INDICES_PER_QUAD] = {base + 0, base + 1, base + 3, base + 2, base + 0, base + 3};
+            std::copy(std::begin(quad), std::end(quad), indices.begin() + q * INDICES_PER_QUAD);
+        }
+        // storage is replaced under the same name, so VAOs created earlier see the new indices
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned), indices.data(), GL_STATIC_DRAW);
+        quad_indices_count = count;
+    }
+}
+
+VertexPtr::VertexPtr(const unsigned v, const size_t fst, const size_t cnt, const bool discard) : VBO(v), first(fst), count(cnt)
 {
     #ifndef ATTRS_PACKED
     unsigned char* ptr = nullptr;
     #endif
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    ptr = static_cast<decltype(ptr)>(glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY));
+    // discarding lets the driver hand out fresh memory instead of waiting on draws still using the old one
+    const GLbitfield access = GL_MAP_WRITE_BIT | (discard ? GL_MAP_INVALIDATE_RANGE_BIT : 0);
+    ptr = static_cast<decltype(ptr)>(glMapBufferRange(GL_ARRAY_BUFFER, first * sizeof(Vertex), count * sizeof(Vertex), access));
     #ifndef ATTRS_PACKED
     pos = ptr + cnt * ((uintptr_t)offsetof(Vertex, pos);
     uv = ptr + cnt * ((uintptr_t)offsetof(Vertex, uv);
@@ -25,7 +59,7 @@ VertexPtr::~VertexPtr()
 VertexRef VertexPtr::operator[](const size_t idx)
 {
     #ifdef ATTRS_PACKED
-    return ptr[idx];
+    return ptr[idx - first];
     #else
     #define DO_PART(p) static_cast<void*>(p + idx * sizeof(Vertex::p))
     return VertexRef(
@@ -37,40 +71,43 @@ VertexRef VertexPtr::operator[](const size_t idx)
     #endif
 }
 
-Buffer::Buffer(const size_t cnt) : count(cnt)
+Buffer::Buffer(const size_t quad_count) : quads(quad_count), instance_VBO(0), instance_count(0), instance_capacity(0)
 {
+    const size_t cnt = quads * VERTS_PER_QUAD;
     glGenVertexArrays(1, &VAO);
     glBindVertexArray(VAO);
+    bind_quad_indices(quads);
 
     glGenBuffers(1, &VBO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     const size_t total_size = sizeof(Vertex) * cnt;
     glBufferData(GL_ARRAY_BUFFER, total_size, nullptr, GL_DYNAMIC_DRAW);
 
-    std::tuple<int, size_t, uintptr_t> attrinfo[] = {
+    std::tuple<int, GLenum, GLboolean, size_t, uintptr_t> attrinfo[] = {
     #ifdef ATTRS_PACKED
-    {3, sizeof(Vertex), (uintptr_t)offsetof(Vertex, pos)},
-    {2, sizeof(Vertex), (uintptr_t)offsetof(Vertex, uv)},
-    {4, sizeof(Vertex), (uintptr_t)offsetof(Vertex, col)},
+    {3, GL_HALF_FLOAT, GL_FALSE, sizeof(Vertex), (uintptr_t)offsetof(Vertex, pos)},
+    {2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(Vertex), (uintptr_t)offsetof(Vertex, uv)},
+    {4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (uintptr_t)offsetof(Vertex, col)},
     #else
-    {3, sizeof(Vertex::pos), cnt * (uintptr_t)offsetof(Vertex, pos)},
-    {2, sizeof(Vertex::uv), cnt * (uintptr_t)offsetof(Vertex, uv)},
-    {4, sizeof(Vertex::col), cnt * (uintptr_t)offsetof(Vertex, col)},
+    {3, GL_HALF_FLOAT, GL_FALSE, sizeof(Vertex::pos), cnt * (uintptr_t)offsetof(Vertex, pos)},
+    {2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(Vertex::uv), cnt * (uintptr_t)offsetof(Vertex, uv)},
+    {4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex::col), cnt * (uintptr_t)offsetof(Vertex, col)},
     #endif
     };
 
     int idx = 0;
-    for(const auto [floatcnt, sz, off] : attrinfo)
+    for(const auto& [elemcnt, type, normalized, sz, off] : attrinfo)
     {
-        glVertexAttribPointer(idx, floatcnt, GL_FLOAT, GL_FALSE, sz, (void*)off);
+        glVertexAttribPointer(idx, elemcnt, type, normalized, sz, (void*)off);
         glEnableVertexAttribArray(idx);
         idx++;
     }
 }
-Buffer::Buffer(Buffer&& b) : count(b.count), VAO(b.VAO), VBO(b.VBO)
+Buffer::Buffer(Buffer&& b) : quads(b.quads), VAO(b.VAO), VBO(b.VBO), instance_VBO(b.instance_VBO), instance_count(b.instance_count), instance_capacity(b.instance_capacity)
 {
     b.VAO = 0;
     b.VBO = 0;
+    b.instance_VBO = 0;
 }
 Buffer::~Buffer()
 {
@@ -80,6 +117,9 @@ Buffer::~Buffer()
     if(VBO) {
         glDeleteBuffers(1, &VBO);
     }
+    if(instance_VBO) {
+        glDeleteBuffers(1, &instance_VBO);
+    }
 }
 void Buffer::bind()
 {
@@ -87,21 +127,95 @@ void Buffer::bind()
 }
 void Buffer::draw()
 {
-    glDrawArrays(GL_TRIANGLES, 0, count);
+    glDrawElements(GL_TRIANGLES, quads * INDICES_PER_QUAD, GL_UNSIGNED_INT, nullptr);
+}
+void Buffer::drawQuads(const size_t first, const size_t cnt)
+{
+    const uintptr_t offset = first * INDICES_PER_QUAD * sizeof(unsigned);
+    glDrawElements(GL_TRIANGLES, cnt * INDICES_PER_QUAD, GL_UNSIGNED_INT, (void*)offset);
+}
+void Buffer::setInstances(const Instance* instances, const size_t count)
+{
+    if(instance_VBO == 0)
+    {
+        glGenBuffers(1, &instance_VBO);
+        glBindBuffer(GL_ARRAY_BUFFER, instance_VBO);
+
+        // the matrix takes one attribute per column
+        const std::pair<int, uintptr_t> attrinfo[] = {
+            {4, (uintptr_t)offsetof(Instance, model)},
+            {4, (uintptr_t)offsetof(Instance, model) + sizeof(glm::vec4)},
+            {4, (uintptr_t)offsetof(Instance, model) + sizeof(glm::vec4) * 2},
+            {4, (uintptr_t)offsetof(Instance, model) + sizeof(glm::vec4) * 3},
+            {4, (uintptr_t)offsetof(Instance, color)},
+            {4, (uintptr_t)offsetof(Instance, params)},
+        };
+
+        int idx = 3;
+        for(const auto& [elemcnt, off] : attrinfo)
+        {
+            glVertexAttribPointer(idx, elemcnt, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)off);
+            glVertexAttribDivisor(idx, 1);
+            glEnableVertexAttribArray(idx);
+            idx++;
+        }
+    }
+    else
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instance_VBO);
+    }
+
+    // streamed every frame: fresh storage when it has to grow, otherwise overwritten in place
+    if(count > instance_capacity)
+    {
+        instance_capacity = count;
+        glBufferData(GL_ARRAY_BUFFER, sizeof(Instance) * count, instances, GL_STREAM_DRAW);
+    }
+    else if(count)
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Instance) * count, instances);
+    }
+    instance_count = count;
+}
+void Buffer::drawInstanced()
+{
+    if(instance_count == 0) return;
+    glDrawElementsInstanced(GL_TRIANGLES, quads * INDICES_PER_QUAD, GL_UNSIGNED_INT, nullptr, instance_count);
 }
 
 VertexPtr Buffer::getAllVerts()
 {
-    return VertexPtr(VBO, count);
+    return VertexPtr(VBO, 0, quads * VERTS_PER_QUAD, false);
+}
+VertexPtr Buffer::getQuads(const size_t first, const size_t cnt)
+{
+    return VertexPtr(VBO, first * VERTS_PER_QUAD, cnt * VERTS_PER_QUAD, true);
 }
 #ifdef ATTRS_PACKED
 void Buffer::writeSingleQuad(const size_t idx, const Vertex* verts)
 {
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferSubData(GL_ARRAY_BUFFER, idx * sizeof(Vertex) * 6, sizeof(Vertex) * 6, verts);
+    glBufferSubData(GL_ARRAY_BUFFER, idx * sizeof(Vertex) * VERTS_PER_QUAD, sizeof(Vertex) * VERTS_PER_QUAD, verts);
 }
 #endif
 
+UniformBuffer::UniformBuffer(const size_t sz, const unsigned binding) : size(sz)
+{
+    glGenBuffers(1, &UBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+    glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, UBO);
+}
+UniformBuffer::~UniformBuffer()
+{
+    glDeleteBuffers(1, &UBO);
+}
+void UniformBuffer::update(const void* data)
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+}
+
 Texture::Texture(const int width, const int height, const unsigned char* ptr)
 {
     glGenTextures(1, &tex);
@@ -123,8 +237,80 @@ void Texture::bind()
 {
     glBindTexture(GL_TEXTURE_2D, tex);
 }
+void Texture::generateMipmaps()
+{
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glGenerateMipmap(GL_TEXTURE_2D);
+}
+void Texture::sampleLevel(const int level)
+{
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level);
+}
+void Texture::sampleAllLevels()
+{
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000); // gl's default
+}
+
+ByteTexture::ByteTexture(const int w, const int h) : width(w)
+{
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // integer textures can't be filtered
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, w, h, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+}
+ByteTexture::~ByteTexture()
+{
+    glDeleteTextures(1, &tex);
+}
+void ByteTexture::bind()
+{
+    glBindTexture(GL_TEXTURE_2D, tex);
+}
+void ByteTexture::update(const int x, const int y, const int w, const int h, const unsigned char* board)
+{
+    glBindTexture(GL_TEXTURE_2D, tex);
+    // rows are as wide as the board, not padded to 4 bytes, and the rectangle starts partway into them
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RED_INTEGER, GL_UNSIGNED_BYTE, board + y * width + x);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
 
-Framebuffer::Framebuffer(const int w, const int h) : out(w, h), width(w), height(h)
+TextureArray::TextureArray(const int w, const int h, const int layers) : width(w), height(h)
+{
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, tex);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, w, h, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+}
+TextureArray::~TextureArray()
+{
+    glDeleteTextures(1, &tex);
+}
+void TextureArray::bind()
+{
+    glBindTexture(GL_TEXTURE_2D_ARRAY, tex);
+}
+void TextureArray::upload(const int layer, const unsigned char* ptr)
+{
+    glBindTexture(GL_TEXTURE_2D_ARRAY, tex);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, ptr);
+}
+
+Framebuffer::Framebuffer(const int w, const int h) : out(w, h), width(w), height(h), attached_level(0)
 {
     glGenFramebuffers(1, &framebuffer);
     glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
@@ -136,7 +322,25 @@ Framebuffer::~Framebuffer()
     glDeleteFramebuffers(1, &framebuffer);
 }
 void Framebuffer::bind()
+{
+    bindLevel(0);
+}
+void Framebuffer::bindLevel(const int level)
 {
     glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-    glViewport(0, 0, width, height);
+    if(level != attached_level)
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, out.tex, level);
+        attached_level = level;
+    }
+    glViewport(0, 0, std::max(1, width >> level), std::max(1, height >> level));
+}
+int Framebuffer::levels() const
+{
+    int n = 1;
+    for(int size = std::max(width, height); size > 1; size /= 2)
+    {
+        ++n;
+    }
+    return n;
 }
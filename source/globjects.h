@@ -1,15 +1,81 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
 #include <cstdio>
+#include <cstring>
 
 #define ATTRS_PACKED
 
+// 16 bytes, the shaders still get floats: positions are half floats, which hold the board's whole
+// coordinates and screen-space positions exactly enough but not tiny offsets from them (those go in
+// the model matrix), uvs are normalized over the whole texture and colors are 8 bits per channel
 struct Vertex {
-    glm::vec3 pos;
-    glm::vec2 uv;
-    glm::vec4 col;
+    glm::u16vec3 pos;
+    glm::uint16 pad;
+    glm::u16vec2 uv;
+    glm::u8vec4 col;
+
+    // inline and without glm's generic packing, every tile change packs a few of these per quad
+    static Vertex pack(const glm::vec3& pos, const glm::vec2& uv, const glm::vec4& col)
+    {
+        return Vertex{
+            {half(pos.x), half(pos.y), half(pos.z)},
+            0,
+            {unorm16(uv.x), unorm16(uv.y)},
+            {unorm8(col.r), unorm8(col.g), unorm8(col.b), unorm8(col.a)},
+        };
+    }
+
+    // rounded like glm::packHalf, done on the float's bits
+    static glm::uint16 half(const float value)
+    {
+        constexpr glm::uint32 f32_infinity = 255u << 23;
+        constexpr glm::uint32 f16_too_big = (127u + 16) << 23;
+        constexpr glm::uint32 f16_smallest_normal = (127u - 14) << 23;
+
+        glm::uint32 bits;
+        memcpy(&bits, &value, sizeof(bits));
+        const glm::uint32 sign = bits & 0x80000000u;
+        bits ^= sign;
+
+        glm::uint32 out;
+        if(bits >= f16_too_big)
+        {
+            out = bits > f32_infinity ? 0x7E00 : 0x7C00; // nan or infinity
+        }
+        else if(bits < f16_smallest_normal)
+        {
+            // subnormal in units of 2^-24, anything under half of one is 0
+            const glm::uint32 exponent = bits >> 23;
+            const glm::uint32 shift = 126 - exponent;
+            const glm::uint32 mantissa = (bits & 0x7FFFFF) | 0x800000;
+            out = exponent < 102 ? 0 : (mantissa + (1u << (shift - 1))) >> shift;
+        }
+        else
+        {
+            // ties away from zero, a carry out of the mantissa bumps the exponent
+            bits += (glm::uint32(15 - 127) << 23) + 0x1000;
+            out = bits >> 13;
+        }
+        return glm::uint16(out | (sign >> 16));
+    }
+
+    static glm::uint16 unorm16(const float value)
+    {
+        return glm::uint16(glm::clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+    }
+
+    static glm::uint8 unorm8(const float value)
+    {
+        return glm::uint8(glm::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
 };
+static_assert(sizeof(Vertex) == 16, "Vertex should stay tightly packed");
+
+// quads are drawn as two triangles through an index buffer shared by every Buffer
+inline constexpr size_t VERTS_PER_QUAD = 4;
+inline constexpr size_t INDICES_PER_QUAD = 6;
 
 #ifdef ATTRS_PACKED
 using VertexRef = Vertex&;
@@ -17,11 +83,11 @@ using VertexRef = Vertex&;
 class VertexRef {
     friend class VertexPtr;
 
-    glm::vec3* const pos;
-    glm::vec2* const uv;
-    glm::vec4* const col;
+    glm::u16vec3* const pos;
+    glm::u16vec2* const uv;
+    glm::u8vec4* const col;
 
-    VertexRef(glm::vec3* pos_, glm::vec2* uv_, glm::vec4* col_) : pos(pos_), uv(uv_), col(col_)
+    VertexRef(glm::u16vec3* pos_, glm::u16vec2* uv_, glm::u8vec4* col_) : pos(pos_), uv(uv_), col(col_)
     {
 
     }
@@ -47,44 +113,58 @@ class VertexPtr {
     #endif
 
     const unsigned VBO;
+    const size_t first;
 public:
     const size_t count;
 
-    VertexPtr(const unsigned v, const size_t cnt);
+    // maps vertices [fst, fst + cnt), still indexed from the start of the buffer.
+    // with discard, what was there before is undefined and all of them have to be written
+    VertexPtr(const unsigned v, const size_t fst, const size_t cnt, const bool discard);
     // make sure to tell OpenGL we're done with the pointer
     ~VertexPtr();
 
     VertexRef operator[](const size_t idx);
 };
 
+// what changes between the copies of a buffer drawn by one drawInstanced, from attribute 3 on
+struct Instance {
+    glm::mat4 model;
+    glm::vec4 color;
+    // avatars: head pitch and limb swing in radians, then their layer in the skin array
+    glm::vec4 params;
+};
+
 class Buffer {
-    const size_t count;
+    const size_t quads;
     unsigned VAO, VBO;
+    // per-instance attributes, only made once the buffer is drawn instanced
+    unsigned instance_VBO;
+    size_t instance_count, instance_capacity;
 
-    Buffer(const size_t cnt);
+    Buffer(const size_t quad_count);
 
 public:
     Buffer(Buffer&&);
 
-    static Buffer Verts(const size_t cnt)
-    {
-        return Buffer(cnt);
-    }
-    static Buffer Tris(const size_t cnt)
-    {
-        return Verts(cnt * 3);
-    }
     static Buffer Quads(const size_t cnt)
     {
-        return Tris(cnt * 2);
+        return Buffer(cnt);
     }
 
     ~Buffer();
 
     void bind();
     void draw();
+    // only quads [first, first + cnt)
+    void drawQuads(const size_t first, const size_t cnt);
+    // replaces the instances, the buffer must be bound
+    void setInstances(const Instance* instances, const size_t count);
+    // one copy of the whole buffer per instance
+    void drawInstanced();
 
     VertexPtr getAllVerts();
+    // only quads [first, first + cnt), which must all be rewritten
+    VertexPtr getQuads(const size_t first, const size_t cnt);
 
     #ifdef ATTRS_PACKED
     void writeSingleQuad(const size_t idx, const Vertex* verts);
@@ -92,6 +172,19 @@ public:
 
 };
 
+// storage for a uniform block, attached to its binding point for good
+class UniformBuffer {
+    unsigned UBO;
+    const size_t size;
+
+public:
+    UniformBuffer(const size_t sz, const unsigned binding);
+    ~UniformBuffer();
+
+    // replaces all of it
+    void update(const void* data);
+};
+
 class Texture
 {
     friend class Framebuffer;
@@ -102,23 +195,70 @@ public:
     ~Texture();
 
     void bind();
+    // (re)builds every smaller level from the full size one and samples between them
+    void generateMipmaps();
+    // samples only that level, so the one below can be drawn from it while it's a render target
+    void sampleLevel(const int level);
+    void sampleAllLevels();
+};
+
+// one unsigned byte per texel, sampled with texelFetch from a usampler2D
+class ByteTexture
+{
+    unsigned tex;
+    const int width;
+
+public:
+    ByteTexture(const int w, const int h);
+    ~ByteTexture();
+
+    void bind();
+    // the w by h rectangle at x, y, read out of a tightly packed board as wide as the texture
+    void update(const int x, const int y, const int w, const int h, const unsigned char* board);
+};
+
+// same sized rgba layers, sampled from a sampler2DArray
+class TextureArray
+{
+    unsigned tex;
+    const int width, height;
+
+public:
+    TextureArray(const int w, const int h, const int layers);
+    ~TextureArray();
+
+    void bind();
+    void upload(const int layer, const unsigned char* ptr);
 };
 
 class Framebuffer {
     Texture out;
     const int width, height;
     unsigned framebuffer;
+    int attached_level;
 
 public:
     Framebuffer(const int w, const int h);
     ~Framebuffer();
 
     void bind();
+    // draws go to that mip level of the output until the next bind(), the viewport sized to it
+    void bindLevel(const int level);
+    // how many mip levels generateMipmaps() makes
+    int levels() const;
 
     void bindOutput()
     {
         out.bind();
     }
+    Texture& output()
+    {
+        return out;
+    }
+    void generateMipmaps()
+    {
+        out.generateMipmaps();
+    }
 };
 
 void glCheckError_(const char *file, int line);
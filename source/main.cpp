@@ -17,6 +17,9 @@
 extern "C" {
     #include <sys/stat.h>
 }
+#ifdef _WIN32
+#include <direct.h>
+#endif
 #ifdef __MINGW32__
 #include "mingw.thread.h"
 #else
@@ -40,6 +43,9 @@ extern "C" {
 #include "shader_fsh.glsl.h"
 #include "flat_shader_vsh.glsl.h"
 #include "world_shader_vsh.glsl.h"
+#include "instanced_shader_vsh.glsl.h"
+#include "avatar_shader_vsh.glsl.h"
+#include "avatar_shader_fsh.glsl.h"
 
 inline constexpr std::string_view CONFIG_VERSION = "v02";
 
@@ -96,11 +102,16 @@ static void server_thread_func(std::unique_ptr<MineServer>&& srv_ptr)
                 first_tick = false;
             }
 
-            if(const float deltaTime = std::chrono::duration<float>{now - last_upd}.count(); deltaTime >= TIME_PER_TICK * 2.0f)
+            // fixed steps, so the tick count is a clock the clients can sync to
+            const auto tick_length = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>{server->current_tick_time()});
+            if(now - last_upd >= tick_length)
             {
-                server->update(deltaTime);
+                server->update(server->current_tick_time());
                 server->send_update();
-                last_upd = now;
+                server->report_tick_cost(std::chrono::duration<float>{std::chrono::steady_clock::now() - now}.count());
+                last_upd += tick_length;
+                // too far behind to catch up without a burst of updates
+                if(now - last_upd > tick_length * 4) last_upd = now;
             }
         }
 
@@ -116,8 +127,14 @@ struct WindowDeleter {
 };
 using WindowPtr = std::unique_ptr<GLFWwindow, WindowDeleter>;
 
-static void do_graphical(std::string filepath, const char* skinpath)
+static void do_graphical(std::string filepath, const char* skinpath, std::string skincache)
 {
+    #ifdef _WIN32
+    _mkdir(skincache.c_str());
+    #else
+    mkdir(skincache.c_str(), 0755);
+    #endif
+
     GLFWmonitor* primary = glfwGetPrimaryMonitor();
     int total_resolutions;
     const GLFWvidmode* m = glfwGetVideoModes(primary, &total_resolutions);
@@ -220,19 +237,33 @@ static void do_graphical(std::string filepath, const char* skinpath)
     constexpr std::string_view world_vsh_shader(Shaders::world_shader_vsh.data(), Shaders::world_shader_vsh.size());
     constexpr std::string_view flat_vsh_shader(Shaders::flat_shader_vsh.data(), Shaders::flat_shader_vsh.size());
     constexpr std::string_view fsh_shader(Shaders::shader_fsh.data(), Shaders::shader_fsh.size());
+    constexpr std::string_view instanced_vsh_shader(Shaders::instanced_shader_vsh.data(), Shaders::instanced_shader_vsh.size());
+    constexpr std::string_view avatar_vsh_shader(Shaders::avatar_shader_vsh.data(), Shaders::avatar_shader_vsh.size());
+    constexpr std::string_view avatar_fsh_shader(Shaders::avatar_shader_fsh.data(), Shaders::avatar_shader_fsh.size());
     Shader worldShader(world_vsh_shader, fsh_shader);
     Shader flatShader(flat_vsh_shader, fsh_shader);
+    Shader instancedShader(instanced_vsh_shader, fsh_shader);
+    Shader avatarShader(avatar_vsh_shader, avatar_fsh_shader);
+    const WorldProgram worldProgram(worldShader), flatProgram(flatShader);
+    const InstancedProgram instancedProgram(instancedShader);
 
     const auto& [tex_width, tex_height, tex_data] = Images::spritesheet;
     glActiveTexture(GL_TEXTURE0);
     Texture spritesheet(tex_width, tex_height, tex_data.data());
     const auto& [skin_width, skin_height, skin_data] = Images::base_skin;
-    Texture default_skin(skin_width, skin_height, skin_data.data());
+    const auto default_skin = fit_skin(skin_data.data(), skin_width, skin_height);
 
     flatShader.use();
     flatShader.setInt("texture1", 0);
+    flatShader.setInt("boardState", 1);
     worldShader.use();
     worldShader.setInt("texture1", 0);
+    worldShader.setInt("boardState", 1);
+    instancedShader.use();
+    instancedShader.setInt("texture1", 0);
+    instancedShader.setInt("boardState", 1);
+    avatarShader.use();
+    avatarShader.setInt("skins", 0);
 
     char username[MAX_NAME_LEN + 1] = {0};
     const auto set_username = [](char* usr) {
@@ -320,6 +351,7 @@ static void do_graphical(std::string filepath, const char* skinpath)
     bool released_esc = false;
     bool first_frame = false;
     bool start_client = false, start_server = false;
+    bool spectate_game = false;
     bool fullscreen = false;
 
    std::vector<std::unique_ptr<char[]>> out_chat;
@@ -330,11 +362,14 @@ static void do_graphical(std::string filepath, const char* skinpath)
     int crosshair_width = 8;
     int crosshair_length = 20;
     int minimap_scale = 10;
+    bool board_texture = true;
 
     int overlay_w = 25;
     int overlay_h = 50;
 
     int map_width = 15, map_height = 15, bombs_percent = 10, player_amount = 2;
+    int spectator_amount = 4, spectator_rate = 2;
+    int tick_rate = DEFAULT_RATES.tick_rate, snapshot_rate = DEFAULT_RATES.snapshot_rate, input_rate = DEFAULT_RATES.input_rate;
     int window_x = 0, window_y = 0;
 
     float client_start_time = 0.0f;
@@ -384,6 +419,7 @@ static void do_graphical(std::string filepath, const char* skinpath)
                         MAP_TO('H', overlay_h, convert_to_int)
                         MAP_TO('Z', minimap_scale, convert_to_int)
                         MAP_TO('F', fov, convert_to_int)
+                        MAP_TO('B', board_texture, convert_to_int)
                         #undef MAP_TO
                         default:
                             break;
@@ -436,27 +472,7 @@ static void do_graphical(std::string filepath, const char* skinpath)
         const auto prev_screen = screen;
         if(screen == MenuScreen::InGame)
         {
-            if(st != MineClient::State::Playing || lastComm >= TIME_PER_TICK)
-            {
-                ENetEvent event;
-                if(client->host && enet_host_service(client->host.get(), &event, 1))
-                {
-                    switch(event.type)
-                    {
-                    case ENET_EVENT_TYPE_CONNECT:
-                        // connection succeeded
-                        break;
-                    case ENET_EVENT_TYPE_RECEIVE:
-                        client->receive_packet(event.packet->data, event.packet->dataLength, out_chat);
-                        // Clean up the packet now that we're done using it.
-                        enet_packet_destroy(event.packet);
-                        break;
-                    case ENET_EVENT_TYPE_DISCONNECT:
-                        client->disconnect(true);
-                        break;
-                    }
-                }
-            }
+            client->poll_network(out_chat);
 
             if(st == MineClient::State::NotConnected)
             {
@@ -501,6 +517,7 @@ static void do_graphical(std::string filepath, const char* skinpath)
                     if(ImGui::SliderInt("HUD width", &overlay_w, 5, 45)) modified_config = true;
                     if(ImGui::SliderInt("HUD height", &overlay_h, 10, 90)) modified_config = true;
                     if(ImGui::SliderInt("Minimap zoom", &minimap_scale, 0, 20)) modified_config = true;
+                    if(ImGui::Checkbox("Single quad floor", &board_texture)) modified_config = true;
 
                     ImGui::Spacing();
                     if(ImGui::SliderInt("Field of View", &fov, 30, 90)) modified_config = true;
@@ -516,6 +533,7 @@ static void do_graphical(std::string filepath, const char* skinpath)
                     if(ImGui::Button("Back to main menu")) client->disconnect(true);
 
                     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+                    ImGui::Text("Round trip time %.0f ms", client->get_rtt() * 1000.0f);
 
                     ImGui::End();
 
@@ -553,7 +571,7 @@ static void do_graphical(std::string filepath, const char* skinpath)
             else
             {
                 glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-                if(client->host) client->disconnect(false);
+                if(client->is_connected()) client->disconnect(false);
                 screen = MenuScreen::AfterGame;
             }
         }
@@ -636,7 +654,7 @@ static void do_graphical(std::string filepath, const char* skinpath)
             {
                 size_t l = strnlen(username, MAX_NAME_LEN);
                 if(l < MAX_NAME_LEN) memset(username + l, 0, MAX_NAME_LEN - l);
-                client = std::make_unique<MineClient>(server_address, skinpath, default_skin, crosshair_color, username);
+                client = std::make_unique<MineClient>(server_address, skinpath, default_skin, crosshair_color, username, spectate_game, skincache);
                 client_start_time = glfwGetTime();
                 start_client = false;
                 in_esc_menu = false;
@@ -646,7 +664,9 @@ static void do_graphical(std::string filepath, const char* skinpath)
 
             if(start_server)
             {
-                server_thread = std::thread(server_thread_func, std::make_unique<MineServer>(map_width, map_height, bombs_percent, player_amount));
+                server_thread = std::thread(server_thread_func, std::make_unique<MineServer>(map_width, map_height, bombs_percent, player_amount, spectator_amount, spectator_rate, ServerRates{
+                    (unsigned char)tick_rate, (unsigned char)std::min(snapshot_rate, tick_rate), (unsigned char)input_rate,
+                }));
                 std::this_thread::sleep_for(std::chrono::milliseconds(250));
 
                 std::fill(std::begin(server_address), std::end(server_address), '\0');
@@ -737,9 +757,20 @@ static void do_graphical(std::string filepath, const char* skinpath)
 
                 ImGui::Spacing();
                 ImGui::SliderInt("Players", &player_amount, Limits::Min::Players, Limits::Max::Players);
+                ImGui::SliderInt("Spectators", &spectator_amount, Limits::Min::Spectators, Limits::Max::Spectators);
+                ImGui::SliderInt("Spectator updates/s", &spectator_rate, Limits::Min::SpectatorRate, Limits::Max::SpectatorRate);
+
+                ImGui::Spacing();
+                ImGui::SliderInt("Ticks/s", &tick_rate, Limits::Min::TickRate, Limits::Max::TickRate);
+                ImGui::SliderInt("Snapshots/s", &snapshot_rate, Limits::Min::SnapshotRate, Limits::Max::SnapshotRate);
+                ImGui::SliderInt("Client inputs/s", &input_rate, Limits::Min::InputRate, Limits::Max::InputRate);
 
                 ImGui::Separator();
-                if(ImGui::Button("Start")) screen = MenuScreen::StartingServer;
+                if(ImGui::Button("Start"))
+                {
+                    spectate_game = false;
+                    screen = MenuScreen::StartingServer;
+                }
                 ImGui::SameLine();
                 if(ImGui::Button("Back")) screen = MenuScreen::Main;
 
@@ -752,7 +783,17 @@ static void do_graphical(std::string filepath, const char* skinpath)
                 ImGui::InputText("Server address", server_address, IM_ARRAYSIZE(server_address));
 
                 ImGui::Separator();
-                if(ImGui::Button("Join")) screen = MenuScreen::StartingClient;
+                if(ImGui::Button("Join"))
+                {
+                    spectate_game = false;
+                    screen = MenuScreen::StartingClient;
+                }
+                ImGui::SameLine();
+                if(ImGui::Button("Spectate"))
+                {
+                    spectate_game = true;
+                    screen = MenuScreen::StartingClient;
+                }
                 ImGui::SameLine();
                 if(ImGui::Button("Back")) screen = MenuScreen::Main;
 
@@ -767,7 +808,11 @@ static void do_graphical(std::string filepath, const char* skinpath)
                 ImGui::SliderInt("Bomb %", &bombs_percent, Limits::Min::BombPercent, Limits::Max::BombPercent);
 
                 ImGui::Separator();
-                if(ImGui::Button("Start")) screen = MenuScreen::StartingLocalServer;
+                if(ImGui::Button("Start"))
+                {
+                    spectate_game = false;
+                    screen = MenuScreen::StartingLocalServer;
+                }
                 ImGui::SameLine();
                 if(ImGui::Button("Back")) screen = MenuScreen::Main;
 
@@ -813,14 +858,15 @@ static void do_graphical(std::string filepath, const char* skinpath)
         if(client && st == MineClient::State::Playing)
         {
             MineClient::RenderInfo info{
-                worldShader, flatShader, spritesheet, display_w, display_h,
+                worldProgram, flatProgram, instancedProgram, avatarShader, spritesheet, display_w, display_h,
                 crosshair_distance, crosshair_width, crosshair_length,
                 minimap_scale,
                 overlay_w, overlay_h,
-                fov
+                fov,
+                board_texture
             };
             client->render(info);
-            if(lastComm >= (TIME_PER_TICK * 2.0f))
+            if(lastComm >= client->get_input_time())
             {
                 client->send();
                 last_ext_upd = now;
@@ -866,6 +912,7 @@ static void do_graphical(std::string filepath, const char* skinpath)
             MAP_TO('H', overlay_h)
             MAP_TO('Z', minimap_scale)
             MAP_TO('F', fov)
+            MAP_TO('B', board_texture)
 
             #undef MAP_TO
             #undef ADD
@@ -883,7 +930,7 @@ static void do_graphical(std::string filepath, const char* skinpath)
 }
 
 #ifndef __SWITCH__
-static void do_server_alone(char** args)
+static void do_server_alone(char** args, const int argc)
 {
     const char* width_a = args[0];
     const int width = atoi(width_a);
@@ -901,8 +948,38 @@ static void do_server_alone(char** args)
     const int players = atoi(players_a);
     if(Limits::Max::Players < players || players < Limits::Min::Players) return;
 
-    printf("Starting server\n - width: %d\n - height: %d\n - bombs %%: %d\n - players: %d\n", width, height, bombs, players);
-    server_thread_func(std::make_unique<MineServer>(width, height, bombs, players));
+    int spectators = 4, spectator_rate = 2;
+    int tick_rate = DEFAULT_RATES.tick_rate, snapshot_rate = DEFAULT_RATES.snapshot_rate, input_rate = DEFAULT_RATES.input_rate;
+    if(argc >= 6)
+    {
+        const char* spectators_a = args[4];
+        spectators = atoi(spectators_a);
+        if(Limits::Max::Spectators < spectators || spectators < Limits::Min::Spectators) return;
+
+        const char* spectator_rate_a = args[5];
+        spectator_rate = atoi(spectator_rate_a);
+        if(Limits::Max::SpectatorRate < spectator_rate || spectator_rate < Limits::Min::SpectatorRate) return;
+    }
+    if(argc == 9)
+    {
+        const char* tick_rate_a = args[6];
+        tick_rate = atoi(tick_rate_a);
+        if(Limits::Max::TickRate < tick_rate || tick_rate < Limits::Min::TickRate) return;
+
+        const char* snapshot_rate_a = args[7];
+        snapshot_rate = atoi(snapshot_rate_a);
+        if(Limits::Max::SnapshotRate < snapshot_rate || snapshot_rate < Limits::Min::SnapshotRate) return;
+        snapshot_rate = std::min(snapshot_rate, tick_rate);
+
+        const char* input_rate_a = args[8];
+        input_rate = atoi(input_rate_a);
+        if(Limits::Max::InputRate < input_rate || input_rate < Limits::Min::InputRate) return;
+    }
+
+    printf("Starting server\n - width: %d\n - height: %d\n - bombs %%: %d\n - players: %d\n - spectators: %d (%d updates/s)\n - rates: %d ticks/s, %d snapshots/s, %d inputs/s\n", width, height, bombs, players, spectators, spectator_rate, tick_rate, snapshot_rate, input_rate);
+    server_thread_func(std::make_unique<MineServer>(width, height, bombs, players, spectators, spectator_rate, ServerRates{
+        (unsigned char)tick_rate, (unsigned char)snapshot_rate, (unsigned char)input_rate,
+    }));
     printf("Server stopped.\n");
 }
 #endif
@@ -916,10 +993,10 @@ int main(int argc, char** argv)
     }
 
     #ifndef __SWITCH__
-    if(argc == 6)
+    if(argc == 6 || argc == 8 || argc == 11)
     {
         const char* server_indicator = argv[1];
-        if(strcmp(server_indicator, "srv") == 0) do_server_alone(argv + 2);
+        if(strcmp(server_indicator, "srv") == 0) do_server_alone(argv + 2, argc - 2);
     }
     else if(argc <= 2)
     #endif
@@ -928,7 +1005,7 @@ int main(int argc, char** argv)
         if(glfwInit())
         {
             std::string confpath = argv[0];
-            do_graphical(confpath + ".cfg", argv[1]);
+            do_graphical(confpath + ".cfg", argv[1], confpath + "_skins");
             glfwTerminate();
         }
     }
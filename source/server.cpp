@@ -1,4 +1,5 @@
 #include "server.h"
+#include "game_limits.h"
 
 #include <algorithm>
 #include <cmath>
@@ -94,6 +95,29 @@ namespace {
         }
     }
 
+    void reset_doing(ServClient& cli)
+    {
+        cli.doing.pitch = enet_uint16(cli.data.pitch);
+        cli.doing.yaw = enet_uint16(cli.data.yaw);
+        cli.doing.x = enet_uint32(cli.data.position[0] * POS_SCALE);
+        cli.doing.y = enet_uint32(cli.data.position[2] * POS_SCALE);
+        cli.doing.looking_at_x = cli.data.looking_at_x;
+        cli.doing.looking_at_y = cli.data.looking_at_y;
+        cli.doing.action = 0;
+        // a new connection counts its inputs from the start again
+        cli.doing.sequence = 0;
+        cli.data.input_sequence = 0;
+        cli.acked_tick = 0;
+    }
+
+    ENetPacket* create_init_packet(const ServerWorldPacketInit& init)
+    {
+        auto packet = enet_packet_create(nullptr, ServerWorldPacketInit::WIRE_SIZE, ENET_PACKET_FLAG_RELIABLE);
+        WireWriter w(packet->data, packet->dataLength);
+        write_packet(w, init);
+        return packet;
+    }
+
     struct MineInfo {
         std::vector<WorldTile>& world;
         const unsigned char width, height;
@@ -178,13 +202,13 @@ namespace {
         }
     }
 
-    int reveal(MineInfo& mines, bool& generated, time_t& start_time, Coord at)
+    int reveal(MineInfo& mines, bool& generated, enet_uint32& start_tick, enet_uint32 now_tick, Coord at)
     {
         if(!generated)
         {
             generate_bombs(mines, at);
             generated = true;
-            start_time = time(nullptr);
+            start_tick = now_tick;
         }
 
         auto& cur = mines.world[at.to_idx()];
@@ -244,52 +268,65 @@ namespace {
     }
 }
 
-MineServer::MineServer(int map_width, int map_height, int bombs_percent, int player_amount)
+MineServer::MineServer(int map_width, int map_height, int bombs_percent, int player_amount, int spectator_amount, int spectator_rate, const ServerRates& server_rates)
 :
 is_all_set(false),
+rates(server_rates),
 width(map_width), height(map_height), had_first(false),
 bombs(map_width * map_height * bombs_percent / 100.0f),
 world(map_width * map_height), clients(player_amount),
-data_to_send(sizeof(ServerWorldPacket) + (sizeof(ServerPlayerPacket) * clients.size()) + world.size() + (MAX_CHAT_LINE_LEN + 1)),
-start_time(0), generated(false)
+data_to_send(ServerWorldPacket::WIRE_SIZE + packed_players_size(clients.size(), PLAYER_QUANTIZATION) + (TileChangePacket::WIRE_SIZE * world.size())),
+spectator_dirty(world.size(), true),
+spectator_data(SpectatorWorldPacket::WIRE_SIZE + packed_players_size(clients.size(), SPECTATOR_QUANTIZATION) + world.size()),
+max_spectators(spectator_amount),
+catchup_turn(0),
+spectator_countdown(0),
+tick_stride(1),
+slow_ticks(0), fast_ticks(0),
+tick_cost(0.0f),
+tile_tick(world.size(), 0),
+tick_count(0),
+start_tick(0),
+chat_history(CHAT_HISTORY_SIZE),
+chat_head(0), chat_count(0), chat_unsent(0),
+generated(false)
 {
+    // snapshots go out every few ticks, never more often than the world changes
+    snapshot_interval = std::max(1, int(roundf(float(rates.tick_rate) / rates.snapshot_rate)));
+    spectator_interval = std::max(1, int(roundf(float(rates.tick_rate) / spectator_rate)));
+
     /* Bind the server to the default localhost.     */
     /* A specific host address can be specified by   */
     /* enet_address_set_host(&address, "x.x.x.x"); */
     address.host = ENET_HOST_ANY;
     address.port = COMMS_PORT;
     auto h = enet_host_create(&address /* the address to bind the server host to */, 
-                               player_amount,
-                               2 /* allow up to 2 channels to be used, 0 and 1 */,
+                               player_amount + spectator_amount /* spectators don't take a player slot */,
+                               CHANNEL_COUNT /* allow up to CHANNEL_COUNT channels to be used */,
                                0 /* assume any amount of incoming bandwidth */,
                                0 /* assume any amount of outgoing bandwidth */);
     host.reset(h);
     h = nullptr;
 
+    init.protocol_version = PROTOCOL_VERSION;
     init.players = clients.size();
     init.width = width;
     init.height = height;
-    init.bombs = ENET_HOST_TO_NET_16(bombs);
+    init.bombs = bombs;
+    init.rates = rates;
 }
 
 void MineServer::update(const float deltatime)
 {
     for(auto& c : clients)
     {
-        if(!c.connected) continue;
-
-        const enet_uint16 yaw_bytes = ENET_NET_TO_HOST_16(c.doing.yaw);
-        int16_t yaw_int = 0;
-        memcpy(&yaw_int, &yaw_bytes, sizeof(int16_t));
-        c.data.yaw = yaw_int;
+        if(!c.connected || !c.set) continue;
 
-        const enet_uint16 pitch_bytes = ENET_NET_TO_HOST_16(c.doing.pitch);
-        int16_t pitch_int = 0;
-        memcpy(&pitch_int, &pitch_bytes, sizeof(int16_t));
-        c.data.pitch = pitch_int;
-
-        c.data.position[0] = ENET_NET_TO_HOST_32(c.doing.x) / POS_SCALE;
-        c.data.position[2] = ENET_NET_TO_HOST_32(c.doing.y) / POS_SCALE;
+        c.data.yaw = int16_t(c.doing.yaw);
+        c.data.pitch = int16_t(c.doing.pitch);
+        c.data.position[0] = c.doing.x / POS_SCALE;
+        c.data.position[2] = c.doing.y / POS_SCALE;
+        c.data.input_sequence = c.doing.sequence;
 
         if(c.data.position[0] < 0.5f)
         {
@@ -331,7 +368,7 @@ void MineServer::update(const float deltatime)
         {
             if(c.data.looking_at_x != -1 && c.data.looking_at_y != -1)
             {
-                if(start_time) toggle_flag(world, cur_state.placed_flags, Coord(c.data.looking_at_x, c.data.looking_at_y, width, height));
+                if(generated) toggle_flag(world, cur_state.placed_flags, Coord(c.data.looking_at_x, c.data.looking_at_y, width, height));
             }
         }
         else if(c.doing.action == 1)
@@ -344,7 +381,7 @@ void MineServer::update(const float deltatime)
                     bombs,
                     cur_state.placed_flags
                 };
-                cur_state.result = reveal(info, generated, start_time, Coord(c.data.looking_at_x, c.data.looking_at_y, width, height));
+                cur_state.result = reveal(info, generated, start_tick, tick_count, Coord(c.data.looking_at_x, c.data.looking_at_y, width, height));
                 if(cur_state.result) return;
             }
         }
@@ -354,12 +391,13 @@ void MineServer::update(const float deltatime)
 }
 void MineServer::send_update()
 {
-    if(start_time)
+    tick_count += tick_stride;
+    if(generated)
     {
-        const auto delta = time(nullptr);
-        const auto d1 = lldiv(delta - start_time, 60);
-        cur_state.seconds = d1.rem;
-        cur_state.minutes = d1.quot;
+        // counted in ticks, so the timer runs on the same clock as everything else
+        const auto elapsed = lldiv((long long)((tick_count - start_tick) * rates.tick_time()), 60);
+        cur_state.seconds = elapsed.rem;
+        cur_state.minutes = elapsed.quot;
     }
     else
     {
@@ -369,36 +407,255 @@ void MineServer::send_update()
         cur_state.placed_flags = 0;
     }
 
+    for(size_t i = 0; i < world.size(); ++i)
+    {
+        auto& t = world[i];
+        if(!t.fresh_visit) continue;
+
+        t.fresh_visit = false;
+        tile_tick[i] = tick_count;
+        spectator_dirty[i] = true;
+    }
+
+    send_player_update();
+    send_chat();
+    send_catchups();
+
+    // spectators get a lower rate, but should still see the end of the game right away
+    spectator_countdown -= tick_stride;
+    if(spectator_countdown <= 0 || cur_state.result)
+    {
+        send_spectator_update();
+        spectator_countdown = spectator_interval;
+    }
+
+    enet_host_flush(host.get());
+}
+
+float MineServer::current_tick_time() const
+{
+    return rates.tick_time() * tick_stride;
+}
+
+void MineServer::report_tick_cost(float seconds)
+{
+    tick_cost += (seconds - tick_cost) * 0.1f;
+
+    // halve the room's rate when updates eat most of the time, bring it back once they're cheap again
+    const float budget = current_tick_time();
+    const int max_stride = std::max(1, rates.tick_rate / Limits::Min::TickRate);
+    slow_ticks = tick_cost > budget * 0.75f ? slow_ticks + 1 : 0;
+    fast_ticks = tick_cost < budget * 0.25f ? fast_ticks + 1 : 0;
+    if(slow_ticks >= 10 && tick_stride < max_stride)
+    {
+        tick_stride = std::min(tick_stride * 2, max_stride);
+        slow_ticks = 0;
+        fprintf(stderr, "Updates are too slow, running at %.1f ticks/s\n", 1.0f / current_tick_time());
+    }
+    else if(fast_ticks >= 50 && tick_stride > 1)
+    {
+        tick_stride /= 2;
+        fast_ticks = 0;
+        fprintf(stderr, "Updates are fast again, running at %.1f ticks/s\n", 1.0f / current_tick_time());
+    }
+}
+
+void MineServer::adapt_snapshot_interval(ServClient& c)
+{
+    // reliable snapshots piling up in enet's queues, or a round trip far above the best one, mean the link is full
+    ENetPeer* peer = c.peer;
+    const bool queued = enet_list_size(&peer->outgoingCommands) > 8;
+    const bool window_full = peer->reliableDataInTransit * 2 > peer->windowSize;
+    const bool slow = peer->roundTripTime > (peer->lowestRoundTripTime * 2) + 100;
+    const int max_interval = std::max(snapshot_interval, rates.tick_rate / 2);
+    if(queued || window_full || slow)
+    {
+        c.snapshot_interval = std::min(c.snapshot_interval * 2, max_interval);
+        c.calm_snapshots = 0;
+    }
+    else if(c.snapshot_interval > snapshot_interval && ++c.calm_snapshots >= 10)
+    {
+        c.snapshot_interval -= 1;
+        c.calm_snapshots = 0;
+    }
+}
+
+const PlayerHistory* MineServer::find_baseline(enet_uint32 tick) const
+{
+    if(tick == 0) return nullptr;
+    const auto it = std::find_if(player_history.begin(), player_history.end(), [tick](const PlayerHistory& h) {
+        return h.tick == tick;
+    });
+    return it == player_history.end() ? nullptr : &*it;
+}
+
+size_t MineServer::write_player_update(enet_uint32 since_tick, const PlayerHistory* baseline, const std::vector<PackedPlayer>& states)
+{
+    BitWriter players_out(&data_to_send[ServerWorldPacket::WIRE_SIZE], packed_players_size(clients.size(), PLAYER_QUANTIZATION));
+    for(size_t i = 0; i < states.size(); ++i)
+    {
+        write_packed_player(players_out, states[i], baseline ? &baseline->states[i] : nullptr, PLAYER_QUANTIZATION);
+    }
+    const size_t players_end = ServerWorldPacket::WIRE_SIZE + players_out.finish();
+    WireWriter out(&data_to_send[players_end], data_to_send.size() - players_end);
+
+    // only the tiles that changed since their last snapshot, they got the rest before (or through their catch-up)
+    enet_uint16 changed = 0;
+    for(size_t i = 0; i < world.size(); ++i)
+    {
+        if(tile_tick[i] <= since_tick) continue;
+
+        write_packet(out, TileChangePacket{enet_uint16(i), static_cast<unsigned char>(world[i].visible)});
+        changed += 1;
+    }
+
     auto sc = cur_state;
-    sc.placed_flags = ENET_HOST_TO_NET_16(sc.placed_flags);
-    memcpy(&data_to_send[0], &sc, sizeof(sc));
+    sc.changed_tiles = changed;
+    sc.tick = tick_count;
+    sc.baseline_tick = baseline ? baseline->tick : 0;
+    WireWriter header(&data_to_send[0], ServerWorldPacket::WIRE_SIZE);
+    write_packet(header, sc);
+    return players_end + out.size();
+}
+
+void MineServer::send_player_update()
+{
+    // the baseline is the newest snapshot the client acked, if it's still kept
+    auto baseline_of = [this](const ServClient& c) -> enet_uint32 {
+        const auto baseline = find_baseline(c.acked_tick);
+        return baseline ? baseline->tick : 0;
+    };
+
+    // clients due this tick with the same last snapshot and baseline get the same packet
+    std::vector<std::pair<enet_uint32, enet_uint32>> groups;
+    for(auto& c : clients)
+    {
+        if(!c.connected || !c.set) continue;
+
+        c.snapshot_countdown -= tick_stride;
+        // everyone should still see the end of the game right away
+        if(c.snapshot_countdown > 0 && !cur_state.result) continue;
 
-    ServerPlayerPacket curdata;
-    size_t idx = sizeof(sc);
+        const auto group = std::make_pair(c.last_snapshot_tick, baseline_of(c));
+        if(std::find(groups.begin(), groups.end(), group) == groups.end())
+        {
+            groups.push_back(group);
+        }
+    }
+    if(groups.empty()) return;
+
+    std::vector<PackedPlayer> states;
+    states.reserve(clients.size());
     for(const auto& c : clients)
     {
-        curdata = c.data.fill_info();
-        memcpy(&data_to_send[idx], &curdata, sizeof(curdata));
-        idx += sizeof(curdata);
+        states.push_back(c.data.pack(PLAYER_QUANTIZATION, width, height));
     }
 
-    for(auto& t : world)
+    for(const auto& [since, baseline_tick] : groups)
     {
-        data_to_send[idx] = t.prepare();
-        t.fresh_visit = false;
-        idx += 1;
+        // players still catching up get these too, and apply them after their catch-up
+        const auto size = write_player_update(since, find_baseline(baseline_tick), states);
+        auto upd_packet(enet_packet_create(data_to_send.data(), size, ENET_PACKET_FLAG_RELIABLE));
+        for(auto& c : clients)
+        {
+            if(!c.connected || !c.set || c.last_snapshot_tick != since || baseline_of(c) != baseline_tick) continue;
+            if(c.snapshot_countdown > 0 && !cur_state.result) continue;
+
+            adapt_snapshot_interval(c);
+            enet_peer_send(c.peer, CHANNEL_WORLD, upd_packet);
+            c.last_snapshot_tick = tick_count;
+            c.snapshot_countdown = c.snapshot_interval;
+        }
+        if(upd_packet->referenceCount == 0) enet_packet_destroy(upd_packet);
     }
 
-    if(chatted.size())
+    player_history.push_back(PlayerHistory{tick_count, std::move(states)});
+    if(player_history.size() > PLAYER_HISTORY_SIZE) player_history.pop_front();
+}
+
+void MineServer::send_spectator_update()
+{
+    if(spectators.empty()) return;
+
+    // everything but the terrain is the same for every spectator
+    SpectatorWorldPacket sc;
+    sc.placed_flags = cur_state.placed_flags;
+    sc.result = cur_state.result;
+    sc.seconds = cur_state.seconds;
+    sc.minutes = cur_state.minutes;
+    sc.tick = tick_count;
+
+    BitWriter players_out(&spectator_data[SpectatorWorldPacket::WIRE_SIZE], packed_players_size(clients.size(), SPECTATOR_QUANTIZATION));
+    for(const auto& c : clients)
     {
-        std::copy(chatted.begin(), chatted.end(), data_to_send.begin() + idx);
-        idx += chatted.size();
-        chatted.clear();
+        write_packed_player(players_out, c.data.pack(SPECTATOR_QUANTIZATION, width, height), nullptr, SPECTATOR_QUANTIZATION);
     }
+    const size_t header_end = SpectatorWorldPacket::WIRE_SIZE + players_out.finish();
 
-    auto upd_packet(enet_packet_create(data_to_send.data(), idx, ENET_PACKET_FLAG_RELIABLE));
-    enet_host_broadcast(host.get(), 1, upd_packet);
-    enet_host_flush(host.get());
+    const auto changed = std::count(spectator_dirty.begin(), spectator_dirty.end(), true);
+    // past that point, a delta would be bigger than just resending the whole terrain
+    const bool delta_too_big = changed * TileChangePacket::WIRE_SIZE >= world.size();
+    // spectators still catching up can't receive snapshots in the middle of their stream
+    const bool needs_delta = !delta_too_big && std::any_of(spectators.begin(), spectators.end(), [](const ServSpectator& s) {
+        return !s.catchup.active() && !s.needs_keyframe;
+    });
+    const bool needs_keyframe = std::any_of(spectators.begin(), spectators.end(), [delta_too_big](const ServSpectator& s) {
+        return !s.catchup.active() && (delta_too_big || s.needs_keyframe);
+    });
+
+    // each packet is built once and shared by every spectator that wants it
+    ENetPacket* delta_packet = nullptr;
+    ENetPacket* keyframe_packet = nullptr;
+    if(needs_delta)
+    {
+        sc.keyframe = 0;
+        sc.changed_tiles = enet_uint16(changed);
+        WireWriter header(&spectator_data[0], SpectatorWorldPacket::WIRE_SIZE);
+        write_packet(header, sc);
+
+        WireWriter out(&spectator_data[header_end], spectator_data.size() - header_end);
+        for(size_t i = 0; i < world.size(); ++i)
+        {
+            if(!spectator_dirty[i]) continue;
+
+            write_packet(out, TileChangePacket{enet_uint16(i), static_cast<unsigned char>(world[i].visible)});
+        }
+        delta_packet = enet_packet_create(spectator_data.data(), header_end + out.size(), ENET_PACKET_FLAG_RELIABLE);
+    }
+    if(needs_keyframe)
+    {
+        sc.keyframe = 1;
+        sc.changed_tiles = 0;
+        WireWriter header(&spectator_data[0], SpectatorWorldPacket::WIRE_SIZE);
+        write_packet(header, sc);
+
+        size_t idx = header_end;
+        for(const auto& t : world)
+        {
+            spectator_data[idx] = t.visible;
+            idx += 1;
+        }
+        keyframe_packet = enet_packet_create(spectator_data.data(), idx, ENET_PACKET_FLAG_RELIABLE);
+    }
+
+    for(auto& s : spectators)
+    {
+        if(s.catchup.active()) continue;
+
+        if(s.needs_keyframe || delta_too_big)
+        {
+            enet_peer_send(s.peer, CHANNEL_CONTROL, keyframe_packet);
+            s.needs_keyframe = false;
+        }
+        else
+        {
+            enet_peer_send(s.peer, CHANNEL_CONTROL, delta_packet);
+        }
+    }
+
+    if(delta_packet && delta_packet->referenceCount == 0) enet_packet_destroy(delta_packet);
+    if(keyframe_packet && keyframe_packet->referenceCount == 0) enet_packet_destroy(keyframe_packet);
+    std::fill(spectator_dirty.begin(), spectator_dirty.end(), false);
 }
 
 void MineServer::receive()
@@ -406,134 +663,506 @@ void MineServer::receive()
     ENetEvent event;
     while(enet_host_service(host.get(), &event, is_all_set ? 0 : 60000) > 0)
     {
-        if(is_all_set)
+        handle_event(event);
+        if(event.type == ENET_EVENT_TYPE_RECEIVE)
         {
-            switch (event.type)
-            {
-            case ENET_EVENT_TYPE_CONNECT: {
-                // impossible
-            } break;
-            case ENET_EVENT_TYPE_RECEIVE: {
-                auto& c = clients[*(char*)(event.peer->data)];
-
-                ClientPlayerPacket cpp;
-                memcpy(&cpp, event.packet->data, sizeof(cpp));
-
-                const auto old_action = c.doing.action;
-                const auto old_x = c.doing.looking_at_x;
-                const auto old_y = c.doing.looking_at_y;
-                c.doing = cpp;
-                if(old_action > c.doing.action)
-                {
-                    c.doing.action = old_action;
-                    c.doing.looking_at_x = old_x;
-                    c.doing.looking_at_y = old_y;
-                }
-                if(event.packet->dataLength > sizeof(c.doing))
-                {
-                    chatted.resize(1 + (event.packet->dataLength - sizeof(c.doing)));
-                    chatted[0] = c.idx;
-                    memcpy(chatted.data() + 1, event.packet->data + sizeof(c.doing), chatted.size() - 1);
-                }
+            // Clean up the packet now that we're done using it.
+            enet_packet_destroy(event.packet);
+        }
+    }
+}
+
+void MineServer::handle_event(const ENetEvent& event)
+{
+    if(event.type == ENET_EVENT_TYPE_CONNECT && connect_version(event.data) != PROTOCOL_VERSION)
+    {
+        fprintf(stderr, "Refused peer on protocol version %u, this server is on %u.\n", connect_version(event.data), PROTOCOL_VERSION);
+        enet_peer_disconnect(event.peer, 0);
+        event.peer->data = nullptr;
+        return;
+    }
+    if(event.type == ENET_EVENT_TYPE_CONNECT && connect_role(event.data) == CONNECT_AS_SPECTATOR)
+    {
+        add_spectator(event.peer);
+        return;
+    }
+
+    if(event.type == ENET_EVENT_TYPE_CONNECT)
+    {
+        connect_player(event.peer);
+        return;
+    }
 
-                // Clean up the packet now that we're done using it.
-                enet_packet_destroy(event.packet);
-            } break;
-            case ENET_EVENT_TYPE_DISCONNECT: {
-                auto& c = clients[*(char*)(event.peer->data)];
-                fprintf(stderr, "Player %d disconnected.\n", c.idx);
-                c.connected = false;
-                /* Reset the peer's client information. */
-                event.peer->data = nullptr;
-            } break;
+    // spectators and refused peers have no client attached
+    const auto client = client_of(event.peer);
+    if(client == nullptr)
+    {
+        if(event.type == ENET_EVENT_TYPE_RECEIVE)
+        {
+            const auto it = std::find_if(spectators.begin(), spectators.end(), [&event](const ServSpectator& s) {
+                return s.peer == event.peer;
+            });
+            if(it != spectators.end() && event.channelID == CHANNEL_SKINS)
+            {
+                queue_skin_requests(it->skin_transfers, event.packet->data, event.packet->dataLength);
             }
         }
+        else if(event.type == ENET_EVENT_TYPE_DISCONNECT)
+        {
+            remove_spectator(event.peer);
+        }
+        return;
+    }
+
+    auto& c = *client;
+    switch (event.type)
+    {
+    case ENET_EVENT_TYPE_RECEIVE: {
+        if(event.channelID == CHANNEL_CHAT)
+        {
+            if(c.set && is_all_set) receive_chat(c, event.packet->data, event.packet->dataLength);
+        }
+        else if(event.channelID == CHANNEL_SKINS)
+        {
+            if(c.set) queue_skin_requests(c.skin_transfers, event.packet->data, event.packet->dataLength);
+        }
+        else if(!c.set)
+        {
+            receive_meta(c, event.packet->data, event.packet->dataLength);
+        }
+        else if(is_all_set)
+        {
+            receive_input(c, event.packet->data, event.packet->dataLength);
+        }
+    } break;
+    case ENET_EVENT_TYPE_DISCONNECT: {
+        if(is_all_set)
+        {
+            fprintf(stderr, "Player %d disconnected.\n", c.idx);
+        }
         else
         {
-            switch (event.type)
-            {
-            case ENET_EVENT_TYPE_CONNECT: {
-                const auto current = find_not_connected();
-                if(current == -1) {
-                    fprintf(stderr, "Impossible to connect\n");
-                    return;
-                }
+            fprintf(stderr, "Player %d disconnected before start of the game.\n", c.idx);
+        }
+        // the slot stays in the game, frozen, until someone else takes it
+        c.connected = false;
+        c.set = false;
+        c.peer = nullptr;
+        c.catchup = CatchUp{};
+        c.skin_transfers.clear();
+        // Reset the peer's client information.
+        event.peer->data = nullptr;
+    } break;
+    default:
+        break;
+    }
+}
 
-                auto& c = clients[current];
-                c.connected = true;
-                c.idx = current;
-                fprintf(stderr, "Player %d connected.\n", c.idx);
+ServClient* MineServer::client_of(const ENetPeer* peer)
+{
+    // players' peers point at the index of their slot, which must still be theirs
+    if(peer->data == nullptr) return nullptr;
 
-                init.your_id = c.idx;
-                
-                auto init_packet(enet_packet_create(&init, sizeof(init), ENET_PACKET_FLAG_RELIABLE));
-                enet_peer_send(event.peer, 0, init_packet);
-
-                had_first = true;
-                // Store any relevant client information here.
-                event.peer->data = &c.idx;
-            } break;
-            case ENET_EVENT_TYPE_RECEIVE: {
-                {
-                    auto& c = clients[*(char*)(event.peer->data)];
-                    PlayerMetaPacket in;
-                    memcpy(&in, event.packet->data, sizeof(in));
-                    c.data.fill(in);
-                    const enet_uint32 skin_size = ENET_NET_TO_HOST_32(in.skinbytes);
-                    if(skin_size != 0)
-                    {
-                        c.skin_start = skins_data.size();
-                        skins_data.insert(skins_data.end(), event.packet->data + sizeof(in), event.packet->data + sizeof(in) + skin_size);
-                        c.skin_end = skins_data.size();
-                    }
-                    c.set = true;
-                }
+    const size_t idx = *static_cast<const unsigned char*>(peer->data);
+    if(idx >= clients.size() || clients[idx].peer != peer) return nullptr;
+    return &clients[idx];
+}
 
-                if((is_all_set = all_set()))
-                {
-                    std::vector<unsigned char> to_send((clients.size() * sizeof(StartDataPacket)) + skins_data.size());
-                    // auto arr = std::make_unique<[]>(clients.size());
-                    size_t idx = 0;
-                    for(auto& cli : clients)
-                    {
-                        fill_pos_and_angle_start(cli.data, idx, clients.size(), width, height);
-                        memcpy(&cli.doing.pitch, &cli.data.pitch, 2);
-                        memcpy(&cli.doing.yaw, &cli.data.yaw, 2);
-                        cli.doing.pitch = ENET_HOST_TO_NET_16(cli.doing.pitch);
-                        cli.doing.yaw = ENET_HOST_TO_NET_16(cli.doing.yaw);
-                        cli.doing.x = ENET_HOST_TO_NET_32(enet_uint32(cli.data.position[0] * POS_SCALE));
-                        cli.doing.y = ENET_HOST_TO_NET_32(enet_uint32(cli.data.position[2] * POS_SCALE));
-                        cli.doing.action = 0;
-
-                        StartDataPacket pck;
-                        pck.info = cli.data.fill_info();
-                        pck.meta = cli.data.fill_meta();
-                        size_t skin_size = cli.skin_end - cli.skin_start;
-                        pck.meta.skinbytes = ENET_HOST_TO_NET_32(skin_size);
-                        memcpy(to_send.data() + idx, &pck, sizeof(pck));
-                        idx += sizeof(pck);
-                        memcpy(to_send.data() + idx, skins_data.data() + cli.skin_start, skin_size);
-                        idx += skin_size;
-                    }
+void MineServer::connect_player(ENetPeer* peer)
+{
+    const auto current = find_not_connected();
+    if(current == -1) {
+        fprintf(stderr, "Impossible to connect, no free player slot\n");
+        enet_peer_disconnect(peer, 0);
+        return;
+    }
 
-                    auto first_packet = enet_packet_create(to_send.data(), to_send.size(), ENET_PACKET_FLAG_RELIABLE);
-                    enet_host_broadcast(host.get(), 0, first_packet);
-                }
+    auto& c = clients[current];
+    c.connected = true;
+    c.peer = peer;
+    c.idx = current;
+    if(is_all_set)
+    {
+        fprintf(stderr, "Player %d joined the game in progress.\n", c.idx);
+    }
+    else
+    {
+        fprintf(stderr, "Player %d connected.\n", c.idx);
+    }
+
+    init.your_id = c.idx;
+
+    enet_peer_send(peer, CHANNEL_CONTROL, create_init_packet(init));
+
+    had_first = true;
+    // Store any relevant client information here.
+    peer->data = &c.idx;
+}
+
+void MineServer::receive_meta(ServClient& c, const unsigned char* data, size_t length)
+{
+    WireReader r(data, length);
+    PlayerMetaPacket in;
+    if(!read_packet(r, in))
+    {
+        fprintf(stderr, "Player %d sent a truncated introduction (%zu bytes), ignored.\n", c.idx, length);
+        return;
+    }
+    // everyone prints names with strnlen, but keep them terminated anyway
+    in.username[MAX_NAME_LEN - 1] = '\0';
+    c.data.fill(in);
+    const enet_uint32 skin_size = in.skinbytes;
+    c.skin = SkinHash{};
+    if(skin_size > MAX_SKIN_BYTES || skin_size != r.remaining())
+    {
+        fprintf(stderr, "Player %d sent an invalid skin (%u bytes), using the default one.\n", c.idx, skin_size);
+    }
+    else if(skin_size != 0)
+    {
+        const auto skin_data = r.bytes(skin_size);
+        c.skin = hash_skin(skin_data, skin_size);
+        if(skins.find(c.skin) == skins.end())
+        {
+            skins.emplace(c.skin, std::vector<unsigned char>(skin_data, skin_data + skin_size));
+        }
+    }
+    c.set = true;
+    prune_skins();
+
+    if(is_all_set)
+    {
+        // joining a game in progress: take over the slot where it was left
+        reset_doing(c);
+        c.catchup = CatchUp{build_catchup()};
+        send_chat_history(c.peer);
+        c.last_snapshot_tick = tick_count;
+        c.snapshot_interval = snapshot_interval;
+        c.snapshot_countdown = 0;
+        // everyone else still shows whoever had the slot before
+        send_player_joined(c);
+    }
+    else if((is_all_set = all_set()))
+    {
+        size_t idx = 0;
+        for(auto& cli : clients)
+        {
+            fill_pos_and_angle_start(cli.data, idx, clients.size(), width, height);
+            reset_doing(cli);
+            idx += 1;
+        }
+
+        const auto catchup = build_catchup();
+        for(auto& cli : clients)
+        {
+            cli.catchup = CatchUp{catchup};
+            cli.last_snapshot_tick = tick_count;
+            cli.snapshot_interval = snapshot_interval;
+            cli.snapshot_countdown = 0;
+        }
+        for(auto& s : spectators)
+        {
+            s.catchup = CatchUp{catchup};
+        }
+    }
+}
+
+void MineServer::send_player_joined(const ServClient& c)
+{
+    PlayerJoinedPacket out;
+    out.player = c.idx;
+    out.meta = c.data.fill_meta();
+    const auto skin_it = skins.find(c.skin);
+    out.meta.skinbytes = skin_it == skins.end() ? 0 : skin_it->second.size();
+    out.skin = out.meta.skinbytes ? c.skin : SkinHash{};
+
+    auto packet = enet_packet_create(nullptr, PlayerJoinedPacket::WIRE_SIZE, ENET_PACKET_FLAG_RELIABLE);
+    WireWriter w(packet->data, packet->dataLength);
+    write_packet(w, out);
+
+    // players and spectators still catching up get it after their stream, on the same channel.
+    // players that haven't sent their meta yet get a stream built afterwards, which already has it
+    for(const auto& cli : clients)
+    {
+        if(&cli != &c && cli.connected && cli.set && cli.peer) enet_peer_send(cli.peer, CHANNEL_CONTROL, packet);
+    }
+    for(const auto& s : spectators)
+    {
+        enet_peer_send(s.peer, CHANNEL_CONTROL, packet);
+    }
+    if(packet->referenceCount == 0) enet_packet_destroy(packet);
+}
+
+void MineServer::receive_input(ServClient& c, const unsigned char* data, size_t length)
+{
+    WireReader r(data, length);
+    ClientPlayerPacket cpp;
+    if(!read_packet(r, cpp) || r.remaining() != 0) return;
+    // nothing (0), reveal (1) or flag (2), anything else would win over a real action below
+    if(cpp.action > 2) return;
+
+    // inputs are unreliable, an older one can't replace a newer one
+    if(cpp.sequence <= c.doing.sequence) return;
+    c.acked_tick = std::max(c.acked_tick, cpp.ack_tick);
+
+    const auto old_action = c.doing.action;
+    const auto old_x = c.doing.looking_at_x;
+    const auto old_y = c.doing.looking_at_y;
+    c.doing = cpp;
+    if(old_action > c.doing.action)
+    {
+        c.doing.action = old_action;
+        c.doing.looking_at_x = old_x;
+        c.doing.looking_at_y = old_y;
+    }
+}
+
+void MineServer::receive_chat(ServClient& c, const unsigned char* data, size_t length)
+{
+    if(length == 0 || length > MAX_CHAT_LINE_LEN_TXT) return;
+    if(c.chat_allowance < 1.0f)
+    {
+        fprintf(stderr, "Player %d is chatting too fast, line dropped.\n", c.idx);
+        return;
+    }
+    c.chat_allowance -= 1.0f;
+
+    // a full ring drops its oldest line, even one not sent yet
+    const size_t slot = (chat_head + chat_count) % CHAT_HISTORY_SIZE;
+    chat_history[slot] = ChatLine{static_cast<unsigned char>(c.idx), std::string(reinterpret_cast<const char*>(data), length)};
+    if(chat_count < CHAT_HISTORY_SIZE)
+    {
+        chat_count += 1;
+    }
+    else
+    {
+        chat_head = (chat_head + 1) % CHAT_HISTORY_SIZE;
+    }
+    chat_unsent = std::min(chat_unsent + 1, chat_count);
+}
+
+ENetPacket* MineServer::create_chat_packet(size_t first, size_t count) const
+{
+    size_t size = ChatBatchPacket::WIRE_SIZE;
+    for(size_t i = first; i < first + count; ++i)
+    {
+        size += ChatLinePacket::WIRE_SIZE + chat_history[(chat_head + i) % CHAT_HISTORY_SIZE].text.size();
+    }
+
+    auto packet = enet_packet_create(nullptr, size, ENET_PACKET_FLAG_RELIABLE);
+    WireWriter w(packet->data, packet->dataLength);
+    write_packet(w, ChatBatchPacket{static_cast<unsigned char>(count)});
+    for(size_t i = first; i < first + count; ++i)
+    {
+        const auto& line = chat_history[(chat_head + i) % CHAT_HISTORY_SIZE];
+        write_packet(w, ChatLinePacket{line.player, static_cast<unsigned char>(line.text.size())});
+        w.bytes(line.text.data(), line.text.size());
+    }
+    return packet;
+}
+
+void MineServer::send_chat_history(ENetPeer* peer) const
+{
+    // only what was already sent to everyone else, the rest goes out with the next batch
+    const size_t sent = chat_count - chat_unsent;
+    if(sent == 0) return;
+
+    enet_peer_send(peer, CHANNEL_CHAT, create_chat_packet(0, sent));
+}
+
+void MineServer::send_chat()
+{
+    const float refill = tick_stride * rates.tick_time() * CHAT_LINES_PER_SEC;
+    for(auto& c : clients)
+    {
+        c.chat_allowance = std::min(CHAT_BURST, c.chat_allowance + refill);
+    }
+    if(chat_unsent == 0) return;
+
+    // everyone gets the same batch, players still catching up apply it after their catch-up
+    auto chat_packet = create_chat_packet(chat_count - chat_unsent, chat_unsent);
+    for(auto& c : clients)
+    {
+        if(c.connected && c.set) enet_peer_send(c.peer, CHANNEL_CHAT, chat_packet);
+    }
+    for(auto& s : spectators)
+    {
+        enet_peer_send(s.peer, CHANNEL_CHAT, chat_packet);
+    }
+    if(chat_packet->referenceCount == 0) enet_packet_destroy(chat_packet);
+    chat_unsent = 0;
+}
+
+std::shared_ptr<const std::vector<unsigned char>> MineServer::build_catchup() const
+{
+    auto out = std::make_shared<std::vector<unsigned char>>();
+    auto& to_send = *out;
+    to_send.reserve((clients.size() * StartDataPacket::WIRE_SIZE) + world.size());
+    to_send.resize(clients.size() * StartDataPacket::WIRE_SIZE);
+    WireWriter w(to_send.data(), to_send.size());
+
+    // only the skin hashes, clients request the ones they don't have yet
+    for(const auto& cli : clients)
+    {
+        StartDataPacket pck;
+        pck.info = cli.data.fill_info();
+        pck.meta = cli.data.fill_meta();
+        const auto skin_it = skins.find(cli.skin);
+        const size_t skin_size = skin_it == skins.end() ? 0 : skin_it->second.size();
+        pck.meta.skinbytes = skin_size;
+        pck.skin = skin_size ? cli.skin : SkinHash{};
+        write_packet(w, pck);
+    }
+
+    // the terrain as it was after the last tick, snapshots from the next ones apply on top of it
+    std::vector<unsigned char> tiles(world.size());
+    std::transform(world.begin(), world.end(), tiles.begin(), [](const WorldTile& t) {
+        return t.visible;
+    });
+    compress_tiles(tiles.data(), tiles.size(), to_send);
+
+    return out;
+}
+
+bool MineServer::send_catchup_chunk(ENetPeer* peer, CatchUp& catchup, size_t& budget)
+{
+    const auto& data = *catchup.data;
+    const size_t chunk_size = std::min(CATCHUP_CHUNK_SIZE, data.size() - catchup.offset);
+    if(chunk_size > budget) return false;
+
+    StreamChunkPacket chunk;
+    chunk.total = enet_uint32(data.size());
+    chunk.offset = enet_uint32(catchup.offset);
+
+    auto chunk_packet = enet_packet_create(nullptr, StreamChunkPacket::WIRE_SIZE + chunk_size, ENET_PACKET_FLAG_RELIABLE);
+    WireWriter w(chunk_packet->data, chunk_packet->dataLength);
+    write_packet(w, chunk);
+    w.bytes(data.data() + catchup.offset, chunk_size);
+    enet_peer_send(peer, CHANNEL_CONTROL, chunk_packet);
+
+    budget -= chunk_size;
+    catchup.offset += chunk_size;
+    if(catchup.offset == data.size())
+    {
+        catchup = CatchUp{};
+        return true;
+    }
+    return false;
+}
+
+void MineServer::queue_skin_requests(std::deque<SkinTransfer>& transfers, const unsigned char* data, size_t length) const
+{
+    // there can't be more different skins than players
+    const size_t hash_size = std::tuple_size<SkinHash>::value;
+    if(length % hash_size != 0 || length / hash_size > clients.size()) return;
+
+    WireReader r(data, length);
+    SkinHash requested;
+    while(r.remaining())
+    {
+        read_packet(r, requested);
+        const bool known = skins.find(requested) != skins.end();
+        const bool queued = std::any_of(transfers.begin(), transfers.end(), [&requested](const SkinTransfer& t) {
+            return t.skin == requested;
+        });
+        if(known && !queued && transfers.size() < clients.size())
+        {
+            transfers.push_back(SkinTransfer{requested});
+        }
+    }
+}
+
+void MineServer::send_skin_chunk(ENetPeer* peer, std::deque<SkinTransfer>& transfers, size_t& budget)
+{
+    while(!transfers.empty())
+    {
+        auto& transfer = transfers.front();
+        const auto skin_it = skins.find(transfer.skin);
+        if(skin_it == skins.end())
+        {
+            // nobody uses it anymore
+            transfers.pop_front();
+            continue;
+        }
+
+        const auto& data = skin_it->second;
+        const size_t chunk_size = std::min(CATCHUP_CHUNK_SIZE, data.size() - transfer.offset);
+        if(chunk_size > budget) return;
+
+        SkinChunkPacket chunk;
+        chunk.skin = transfer.skin;
+        chunk.total = enet_uint32(data.size());
+        chunk.offset = enet_uint32(transfer.offset);
+
+        auto chunk_packet = enet_packet_create(nullptr, SkinChunkPacket::WIRE_SIZE + chunk_size, ENET_PACKET_FLAG_RELIABLE);
+        WireWriter w(chunk_packet->data, chunk_packet->dataLength);
+        write_packet(w, chunk);
+        w.bytes(data.data() + transfer.offset, chunk_size);
+        enet_peer_send(peer, CHANNEL_SKINS, chunk_packet);
+
+        budget -= chunk_size;
+        transfer.offset += chunk_size;
+        if(transfer.offset == data.size())
+        {
+            transfers.pop_front();
+        }
+        return;
+    }
+}
+
+void MineServer::prune_skins()
+{
+    for(auto it = skins.begin(); it != skins.end();)
+    {
+        const bool used = std::any_of(clients.begin(), clients.end(), [&it](const ServClient& cli) {
+            return cli.skin == it->first;
+        });
+        if(used)
+        {
+            ++it;
+        }
+        else
+        {
+            it = skins.erase(it);
+        }
+    }
+}
 
-                // Clean up the packet now that we're done using it.
-                enet_packet_destroy(event.packet);
-            } break;
-            case ENET_EVENT_TYPE_DISCONNECT: { // impossible?
-                auto& c = clients[*(char*)(event.peer->data)];
-                fprintf(stderr, "Player %d disconnected before start of the game.\n", c.idx);
-                c.connected = false;
-                c.set = false;
-                // Reset the peer's client information.
-                event.peer->data = nullptr;
-            } break;
+void MineServer::send_catchups()
+{
+    // at most one chunk per peer and a few per tick overall, so joins are spread over several ticks.
+    // the first peer served changes every tick, so when the budget runs out it isn't always the
+    // spectators that wait
+    size_t budget = std::max(CATCHUP_CHUNK_SIZE, CATCHUP_BYTES_PER_SEC / rates.tick_rate);
+    const size_t peers = clients.size() + spectators.size();
+    for(size_t i = 0; i < peers; ++i)
+    {
+        const size_t p = (catchup_turn + i) % peers;
+        if(p < clients.size())
+        {
+            auto& c = clients[p];
+            if(c.catchup.active())
+            {
+                send_catchup_chunk(c.peer, c.catchup, budget);
+            }
+            else if(c.connected)
+            {
+                send_skin_chunk(c.peer, c.skin_transfers, budget);
+            }
+        }
+        else
+        {
+            auto& s = spectators[p - clients.size()];
+            if(s.catchup.active())
+            {
+                if(send_catchup_chunk(s.peer, s.catchup, budget)) s.needs_keyframe = true;
+            }
+            else
+            {
+                send_skin_chunk(s.peer, s.skin_transfers, budget);
             }
         }
     }
+    catchup_turn = peers ? (catchup_turn + 1) % peers : 0;
 }
 
 bool MineServer::all_set() const
@@ -558,3 +1187,37 @@ int MineServer::find_not_connected()
     }
     return -1;
 }
+void MineServer::add_spectator(ENetPeer* peer)
+{
+    if(spectators.size() >= max_spectators)
+    {
+        fprintf(stderr, "Refused spectator, too many already.\n");
+        enet_peer_disconnect(peer, 0);
+        return;
+    }
+
+    spectators.push_back(ServSpectator{peer, true, CatchUp{}, {}});
+    fprintf(stderr, "Spectator connected (%zu watching).\n", spectators.size());
+    peer->data = nullptr;
+
+    auto spec_init = init;
+    spec_init.your_id = SPECTATOR_ID;
+    enet_peer_send(peer, CHANNEL_CONTROL, create_init_packet(spec_init));
+
+    if(is_all_set)
+    {
+        spectators.back().catchup = CatchUp{build_catchup()};
+        send_chat_history(peer);
+    }
+}
+void MineServer::remove_spectator(ENetPeer* peer)
+{
+    const auto it = std::find_if(spectators.begin(), spectators.end(), [peer](const ServSpectator& s) {
+        return s.peer == peer;
+    });
+    if(it != spectators.end())
+    {
+        spectators.erase(it);
+        fprintf(stderr, "Spectator disconnected (%zu watching).\n", spectators.size());
+    }
+}
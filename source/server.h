@@ -3,22 +3,74 @@
 #include "comms.h"
 #include <vector>
 #include <string>
+#include <memory>
+#include <deque>
+#include <map>
 #include <ctime>
 
+// catch-up state being streamed to a peer, shared between everyone joining at the same time
+struct CatchUp {
+    std::shared_ptr<const std::vector<unsigned char>> data;
+    size_t offset = 0;
+
+    bool active() const
+    {
+        return bool(data);
+    }
+};
+
+// skin requested by a peer, sent a chunk at a time
+struct SkinTransfer {
+    SkinHash skin;
+    size_t offset = 0;
+};
+
+// player states as sent on a tick, kept so later snapshots can be deltas against what a client acked
+struct PlayerHistory {
+    enet_uint32 tick;
+    std::vector<PackedPlayer> states;
+};
+inline constexpr size_t PLAYER_HISTORY_SIZE = 32;
+
+// a line someone said, the last few are kept for whoever joins later
+struct ChatLine {
+    unsigned char player;
+    std::string text;
+};
+inline constexpr size_t CHAT_HISTORY_SIZE = 16;
+// every player can say CHAT_BURST lines at once, then CHAT_LINES_PER_SEC on average
+inline constexpr float CHAT_BURST = 3.0f;
+inline constexpr float CHAT_LINES_PER_SEC = 0.5f;
+
 struct ServClient {
     char idx;
     bool set = false;
     bool connected = false;
+    ENetPeer* peer = nullptr;
     PlayerData data;
     ClientPlayerPacket doing;
-    size_t skin_start = 0, skin_end = 0;
+    enet_uint32 acked_tick = 0; // newest update the client says it has
+    // snapshots are sent every snapshot_interval ticks, more apart when the peer can't keep up
+    enet_uint32 last_snapshot_tick = 0;
+    int snapshot_interval = 1, snapshot_countdown = 0, calm_snapshots = 0;
+    CatchUp catchup;
+    SkinHash skin{};
+    std::deque<SkinTransfer> skin_transfers;
+    float chat_allowance = CHAT_BURST; // lines it can still say right now
+};
+
+struct ServSpectator {
+    ENetPeer* peer;
+    bool needs_keyframe = true;
+    CatchUp catchup;
+    std::deque<SkinTransfer> skin_transfers;
 };
 
 struct WorldTile {
     char hidden = '0';
     char visible = '.';
     bool visited = false;
-    bool fresh_visit = true;
+    bool fresh_visit = false;
 
     void visit()
     {
@@ -29,30 +81,51 @@ struct WorldTile {
     {
         visible = hidden;
     }
-
-    unsigned char prepare()
-    {
-        using u8 = unsigned char;
-        u8 out = visible;
-        out |= u8(fresh_visit) << 7;
-        return out;
-    }
 };
 
 struct MineServer {
-    MineServer(int map_width, int map_height, int bombs_percent, int player_amount);
+    MineServer(int map_width, int map_height, int bombs_percent, int player_amount, int spectator_amount, int spectator_rate, const ServerRates& server_rates);
 
     bool is_all_set;
+    const ServerRates rates;
+
+    // time between updates right now, longer than the nominal tick when the room is overloaded
+    float current_tick_time() const;
+    void report_tick_cost(float seconds);
 
     void update(const float deltatime);
     void send_update();
 
     void receive();
+    // what receive does with each event, everything a peer can make the server do goes through here
+    void handle_event(const ENetEvent& event);
     bool should_shutdown() const;
 
 private:
     bool all_set() const;
     int find_not_connected();
+    void connect_player(ENetPeer* peer);
+    ServClient* client_of(const ENetPeer* peer);
+    void receive_meta(ServClient& c, const unsigned char* data, size_t length);
+    void send_player_joined(const ServClient& c);
+    void receive_input(ServClient& c, const unsigned char* data, size_t length);
+    void receive_chat(ServClient& c, const unsigned char* data, size_t length);
+    ENetPacket* create_chat_packet(size_t first, size_t count) const;
+    void send_chat_history(ENetPeer* peer) const;
+    void send_chat();
+    std::shared_ptr<const std::vector<unsigned char>> build_catchup() const;
+    bool send_catchup_chunk(ENetPeer* peer, CatchUp& catchup, size_t& budget);
+    void queue_skin_requests(std::deque<SkinTransfer>& transfers, const unsigned char* data, size_t length) const;
+    void send_skin_chunk(ENetPeer* peer, std::deque<SkinTransfer>& transfers, size_t& budget);
+    void prune_skins();
+    void send_catchups();
+    void add_spectator(ENetPeer* peer);
+    void remove_spectator(ENetPeer* peer);
+    void send_player_update();
+    void adapt_snapshot_interval(ServClient& c);
+    size_t write_player_update(enet_uint32 since_tick, const PlayerHistory* baseline, const std::vector<PackedPlayer>& states);
+    const PlayerHistory* find_baseline(enet_uint32 tick) const;
+    void send_spectator_update();
 
     unsigned char width, height;
     bool had_first;
@@ -60,13 +133,33 @@ private:
     std::vector<WorldTile> world;
     std::vector<ServClient> clients;
     std::vector<unsigned char> data_to_send;
-    std::vector<unsigned char> skins_data;
+    // every skin in use, by content hash, so identical ones are only stored and sent once
+    std::map<SkinHash, std::vector<unsigned char>> skins;
+
+    std::vector<ServSpectator> spectators;
+    std::vector<bool> spectator_dirty;
+    std::vector<unsigned char> spectator_data;
+    size_t max_spectators;
+    // who send_catchups serves first, clients then spectators, moved along every tick
+    size_t catchup_turn;
+    int spectator_interval, spectator_countdown;
+    int snapshot_interval;
+    // the room skips ticks (tick_stride > 1) while updates take too long, tick numbers still count nominal ticks
+    int tick_stride;
+    int slow_ticks, fast_ticks;
+    float tick_cost;
+    std::vector<enet_uint32> tile_tick; // when each tile last changed
+    std::deque<PlayerHistory> player_history;
+
     ENetHostPtr host;
     ENetAddress address;
 
     ServerWorldPacketInit init;
     ServerWorldPacket cur_state;
-    time_t start_time;
-    std::string chatted;
+    enet_uint32 tick_count;
+    enet_uint32 start_tick;
+    // ring of the last CHAT_HISTORY_SIZE lines, oldest at chat_head, the newest chat_unsent not sent yet
+    std::vector<ChatLine> chat_history;
+    size_t chat_head, chat_count, chat_unsent;
     bool generated;
 };
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+// FIPS 180-4 SHA-256 of a whole buffer at once
+std::array<unsigned char, 32> sha256(const unsigned char* data, size_t length);
@@ -7,6 +7,47 @@
 #include <string>
 #include <cstdio>
 
+// view and projection, shared by every program with a Camera block through this binding point
+inline constexpr GLuint CAMERA_BLOCK_BINDING = 0;
+struct CameraBlock {
+    glm::mat4 view;
+    glm::mat4 projection;
+};
+
+// a uniform located once after linking. setting it needs its program in use,
+// a program without it gets -1 and ignores what's set
+template<typename T>
+class Uniform
+{
+    GLint location = -1;
+
+public:
+    Uniform() = default;
+    explicit Uniform(GLint loc) : location(loc) { }
+
+    void set(const T& value) const;
+};
+template<>
+inline void Uniform<bool>::set(const bool& value) const
+{
+    glUniform1i(location, (int)value);
+}
+template<>
+inline void Uniform<glm::ivec2>::set(const glm::ivec2& value) const
+{
+    glUniform2i(location, value.x, value.y);
+}
+template<>
+inline void Uniform<glm::vec4>::set(const glm::vec4& value) const
+{
+    glUniform4fv(location, 1, &value[0]);
+}
+template<>
+inline void Uniform<glm::mat4>::set(const glm::mat4& mat) const
+{
+    glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+}
+
 class Shader
 {
     static inline constexpr const char* ERR_TYPE_FRAGMENT = "FRAGMENT";
@@ -72,6 +113,15 @@ public:
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+
+        const GLuint camera = glGetUniformBlockIndex(ID, "Camera");
+        if(camera != GL_INVALID_INDEX) glUniformBlockBinding(ID, camera, CAMERA_BLOCK_BINDING);
+    }
+    // look up once and keep, whoever draws with the program knows which uniforms it has
+    template<typename T>
+    Uniform<T> uniform(const char* name) const
+    {
+        return Uniform<T>(glGetUniformLocation(ID, name));
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -0,0 +1,95 @@
+#include "skin_decoder.h"
+
+#define LODEPNG_NO_COMPILE_ENCODER
+#define LODEPNG_NO_COMPILE_DISK
+#include "lodepng.h"
+
+#include <algorithm>
+
+std::vector<unsigned char> fit_skin(const unsigned char* pixels, unsigned width, unsigned height)
+{
+    std::vector<unsigned char> out(SKIN_SIZE * SKIN_SIZE * 4);
+    for(unsigned y = 0; y < SKIN_SIZE; ++y)
+    {
+        const unsigned from_y = y * height / SKIN_SIZE;
+        for(unsigned x = 0; x < SKIN_SIZE; ++x)
+        {
+            const unsigned from_x = x * width / SKIN_SIZE;
+            std::copy_n(pixels + (from_y * width + from_x) * 4, 4, out.begin() + (y * SKIN_SIZE + x) * 4);
+        }
+    }
+    return out;
+}
+
+SkinDecoder::SkinDecoder(unsigned worker_count)
+:
+stopping(false)
+{
+    for(unsigned i = 0; i < worker_count; ++i)
+    {
+        workers.emplace_back(&SkinDecoder::work, this);
+    }
+}
+
+SkinDecoder::~SkinDecoder()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    has_jobs.notify_all();
+    for(auto& w : workers)
+    {
+        w.join();
+    }
+}
+
+void SkinDecoder::push(const SkinHash& hash, std::vector<unsigned char>&& png)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(Job{hash, std::move(png)});
+    }
+    has_jobs.notify_one();
+}
+
+bool SkinDecoder::pop(DecodedSkin& out)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if(done.empty()) return false;
+    out = std::move(done.front());
+    done.pop_front();
+    return true;
+}
+
+void SkinDecoder::work()
+{
+    while(true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            has_jobs.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if(stopping) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        DecodedSkin skin;
+        skin.hash = job.hash;
+        std::vector<unsigned char> pixels;
+        unsigned width = 0, height = 0;
+        if(lodepng::decode(pixels, width, height, job.png.data(), job.png.size()) == 0 && width != 0 && height != 0)
+        {
+            const unsigned w_b = width * 4;
+            for(unsigned from_s = 0, from_e = ((height - 1) * w_b); from_s < from_e; from_s += w_b, from_e -= w_b)
+            {
+                std::swap_ranges(pixels.begin() + from_e, pixels.begin() + from_e + w_b, pixels.begin() + from_s);
+            }
+            skin.pixels = fit_skin(pixels.data(), width, height);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        done.push_back(std::move(skin));
+    }
+}
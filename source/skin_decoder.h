@@ -0,0 +1,52 @@
+#pragma once
+
+#include "comms.h"
+
+#include <vector>
+#include <deque>
+#ifdef __MINGW32__
+#include "mingw.thread.h"
+#include "mingw.mutex.h"
+#include "mingw.condition_variable.h"
+#else
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+
+// every skin is scaled to this square, so they can all be layers of one texture array
+inline constexpr unsigned SKIN_SIZE = 64;
+
+// SKIN_SIZE square rgba pixels, rows already flipped for opengl. empty if the png was invalid
+struct DecodedSkin {
+    SkinHash hash;
+    std::vector<unsigned char> pixels;
+};
+
+// nearest neighbour scaling of rgba pixels to SKIN_SIZE square, skins are mapped through
+// normalized uvs so this only changes their resolution
+std::vector<unsigned char> fit_skin(const unsigned char* pixels, unsigned width, unsigned height);
+
+// decodes skin pngs on worker threads, the owner creates the textures on the gl thread
+struct SkinDecoder {
+    explicit SkinDecoder(unsigned worker_count);
+    ~SkinDecoder();
+
+    void push(const SkinHash& hash, std::vector<unsigned char>&& png);
+    bool pop(DecodedSkin& out);
+
+private:
+    struct Job {
+        SkinHash hash;
+        std::vector<unsigned char> png;
+    };
+
+    void work();
+
+    std::mutex mutex;
+    std::condition_variable has_jobs;
+    std::deque<Job> jobs;
+    std::deque<DecodedSkin> done;
+    bool stopping;
+    std::vector<std::thread> workers;
+};
@@ -0,0 +1,85 @@
+#include "snapshots.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    float angle_delta(float from, float to)
+    {
+        float d = std::fmod(to - from, 360.0f);
+        if(d > 180.0f) d -= 360.0f;
+        else if(d < -180.0f) d += 360.0f;
+        return d;
+    }
+
+    void apply(PlayerData& p, const glm::vec3& position, float yaw, float pitch, float moved)
+    {
+        p.position = position;
+        p.yaw = int16_t(std::lround(yaw));
+        p.pitch = int16_t(std::lround(pitch));
+        p.movedDistance = moved;
+    }
+}
+
+void PlayerSnapshots::push(float time, const PlayerData& p)
+{
+    // snapshots come in order, anything else is a replay
+    if(count && time <= at(0).time) return;
+
+    ring[next] = Snapshot{time, p.position, float(p.yaw), float(p.pitch)};
+    next = (next + 1) % ring.size();
+    count = std::min(count + 1, ring.size());
+}
+
+bool PlayerSnapshots::sample(float time, PlayerData& p) const
+{
+    if(count == 0) return false;
+
+    const auto& newest = at(0);
+    if(time >= newest.time)
+    {
+        if(count == 1)
+        {
+            apply(p, newest.position, newest.yaw, newest.pitch, 0.0f);
+            return true;
+        }
+
+        // keep going the same way for a bit, then stop
+        const auto& prev = at(1);
+        const float span = newest.time - prev.time;
+        const float ahead = std::min(time - newest.time, MAX_EXTRAPOLATION);
+        const float f = ahead / span;
+        const bool stopped = (time - newest.time) >= MAX_EXTRAPOLATION;
+        apply(p,
+            newest.position + (newest.position - prev.position) * f,
+            newest.yaw + angle_delta(prev.yaw, newest.yaw) * f,
+            glm::clamp(newest.pitch + (newest.pitch - prev.pitch) * f, -89.0f, 89.0f),
+            stopped ? 0.0f : glm::distance(newest.position, prev.position));
+        return true;
+    }
+
+    for(size_t age = 1; age < count; ++age)
+    {
+        const auto& from = at(age);
+        if(time < from.time) continue;
+
+        const auto& to = at(age - 1);
+        const float f = (time - from.time) / (to.time - from.time);
+        apply(p,
+            glm::mix(from.position, to.position, f),
+            from.yaw + angle_delta(from.yaw, to.yaw) * f,
+            from.pitch + (to.pitch - from.pitch) * f,
+            glm::distance(from.position, to.position));
+        return true;
+    }
+
+    // older than anything kept
+    const auto& oldest = at(count - 1);
+    apply(p, oldest.position, oldest.yaw, oldest.pitch, 0.0f);
+    return true;
+}
+
+const PlayerSnapshots::Snapshot& PlayerSnapshots::at(size_t age) const
+{
+    return ring[(next + ring.size() - 1 - age) % ring.size()];
+}
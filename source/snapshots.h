@@ -0,0 +1,28 @@
+#pragma once
+
+#include "comms.h"
+
+#include <array>
+
+inline constexpr float INTERPOLATION_DELAY = 0.1f; // seconds remote players are drawn in the past
+inline constexpr float MAX_EXTRAPOLATION = 0.25f; // how long they keep moving when snapshots stop coming
+
+// recent server states of a remote player, so it can be drawn between them instead of jumping to each one
+struct PlayerSnapshots {
+    struct Snapshot {
+        float time; // server time in seconds
+        glm::vec3 position;
+        float yaw, pitch;
+    };
+
+    void push(float time, const PlayerData& p);
+    // sets the position, angles and movedDistance of p at that server time, false if there's nothing yet
+    bool sample(float time, PlayerData& p) const;
+
+private:
+    // 0 is the newest
+    const Snapshot& at(size_t age) const;
+
+    std::array<Snapshot, 16> ring;
+    size_t count = 0, next = 0;
+};
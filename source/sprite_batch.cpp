@@ -0,0 +1,78 @@
+#include "sprite_batch.h"
+
+#include <algorithm>
+#include <cstring>
+
+SpriteBatch::SpriteBatch(const size_t max_quads)
+:
+buf(Buffer::Quads(max_quads)), uploaded(max_quads * VERTS_PER_QUAD), next_quad(0)
+{
+    // nothing packs to all ones, so every quad is uploaded the first time it's added
+    memset(uploaded.data(), 0xFF, uploaded.size() * sizeof(Vertex));
+}
+
+void SpriteBatch::begin()
+{
+    next_quad = 0;
+    runs.clear();
+}
+
+void SpriteBatch::use(Texture& texture)
+{
+    if(!runs.empty() && runs.back().texture == &texture) return;
+    runs.push_back(Run{&texture, next_quad, 0});
+}
+
+void SpriteBatch::add(const PDD3& pos, const PDD2& uv, const glm::vec4& color, const glm::mat4& model)
+{
+    if(next_quad * VERTS_PER_QUAD >= uploaded.size()) return;
+    const size_t idx = next_quad++;
+    if(!runs.empty()) runs.back().quads += 1;
+
+    // affine, so the corner moves like a point and the deltas like directions
+    const glm::vec3 p = model * glm::vec4(pos.p, 1.0f);
+    const glm::vec3 dr = model * glm::vec4(pos.dr, 0.0f);
+    const glm::vec3 dd = model * glm::vec4(pos.dd, 0.0f);
+
+    // same corners as Fillers::fill_quad_generic
+    const Vertex quad[VERTS_PER_QUAD] = {
+        Vertex::pack(p, uv.p, color),
+        Vertex::pack(p + dr, uv.p + uv.dr, color),
+        Vertex::pack(p - dd, uv.p - uv.dd, color),
+        Vertex::pack(p + dr - dd, uv.p + uv.dr - uv.dd, color),
+    };
+
+    Vertex* at = &uploaded[Fillers::mkidx(0, idx)];
+    if(memcmp(at, quad, sizeof(quad)) == 0) return;
+
+    // one at a time, a changed range could cover kept quads in between
+    memcpy(at, quad, sizeof(quad));
+    buf.writeSingleQuad(idx, quad);
+}
+
+void SpriteBatch::keep(const size_t cnt)
+{
+    // their owners write them behind our back, whatever is added there later has to be uploaded
+    const size_t first = std::min(next_quad * VERTS_PER_QUAD, uploaded.size());
+    const size_t last = std::min((next_quad + cnt) * VERTS_PER_QUAD, uploaded.size());
+    memset(uploaded.data() + first, 0xFF, (last - first) * sizeof(Vertex));
+
+    next_quad += cnt;
+    if(!runs.empty()) runs.back().quads += cnt;
+}
+
+Buffer& SpriteBatch::buffer()
+{
+    return buf;
+}
+
+void SpriteBatch::draw()
+{
+    buf.bind();
+    for(const auto& run : runs)
+    {
+        if(!run.quads) continue;
+        run.texture->bind();
+        buf.drawQuads(run.first_quad, run.quads);
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "fillers.h"
+
+#include <vector>
+
+// screen-space quads drawn from a single buffer, one draw per run of quads sampling the same
+// texture. each quad goes through its transform on the CPU as it's added, so the shader's model
+// stays the identity. quads are added again every frame but only the ones that came out
+// different from last time are uploaded
+class SpriteBatch {
+    Buffer buf;
+    // what the added quads in the buffer are, to only upload the ones that changed
+    std::vector<Vertex> uploaded;
+    size_t next_quad;
+
+    struct Run {
+        Texture* texture;
+        size_t first_quad, quads;
+    };
+    std::vector<Run> runs;
+
+public:
+    explicit SpriteBatch(const size_t max_quads);
+
+    // the frame's quads start again from the first one
+    void begin();
+    // the next quads sample texture, until the next use
+    void use(Texture& texture);
+    // pos is put through model before it's packed
+    void add(const PDD3& pos, const PDD2& uv, const glm::vec4& color, const glm::mat4& model);
+    // the next cnt quads are written straight into buffer() by whoever owns them, like a TextRun,
+    // and are drawn as they are
+    void keep(const size_t cnt);
+    Buffer& buffer();
+    // everything added since begin
+    void draw();
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// bounded lock-free queue for exactly one producer thread and one consumer thread
+template<typename T, size_t Capacity>
+struct SpscQueue {
+    bool try_push(T&& value)
+    {
+        const size_t tail = write_idx.load(std::memory_order_relaxed);
+        const size_t next = (tail + 1) % Size;
+        if(next == read_idx.load(std::memory_order_acquire)) return false;
+
+        slots[tail] = std::move(value);
+        write_idx.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& out)
+    {
+        const size_t head = read_idx.load(std::memory_order_relaxed);
+        if(head == write_idx.load(std::memory_order_acquire)) return false;
+
+        out = std::move(slots[head]);
+        read_idx.store((head + 1) % Size, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // one slot is always left empty to tell full from empty
+    static constexpr size_t Size = Capacity + 1;
+    std::array<T, Size> slots;
+    alignas(64) std::atomic<size_t> read_idx{0};
+    alignas(64) std::atomic<size_t> write_idx{0};
+};
@@ -0,0 +1,156 @@
+#include "text.h"
+
+#include <array>
+#include <utility>
+
+namespace {
+
+    template<size_t N>
+    constexpr std::array<UVArr, N> generate_char_uvs(const std::array<std::pair<int, int>, N>& coords)
+    {
+        std::array<UVArr, N> out;
+
+        constexpr float delta_u = 0.0625f;
+        constexpr float delta_v = 0.125f;
+        constexpr float extra_u = 8.0f / 1024.0f;
+        constexpr float extra_v = 8.0f / 512.0f;
+
+        for(size_t i = 0; i < N; ++i)
+        {
+            auto& num = out[i];
+            const auto [col, row] = coords[i];
+            auto l_u = 0.5f + delta_u * col;
+            auto b_v = delta_v * row;
+            const auto r_u = l_u + delta_u - extra_u;
+            const auto t_v = b_v + delta_v - extra_v;
+            l_u += extra_u;
+            b_v += extra_v;
+
+            std::get<0>(num) = l_u;
+            std::get<1>(num) = t_v;
+            std::get<2>(num) = r_u - l_u;
+            std::get<3>(num) = t_v - b_v;
+        }
+
+        return out;
+    }
+
+    template<size_t N>
+    constexpr std::array<std::pair<int, int>, N> generate_char_pos(const int start_x, const int start_y)
+    {
+        int cur_x = start_x;
+        int cur_y = start_y;
+        std::array<std::pair<int, int>, N> pos;
+        for(auto& [x, y] : pos)
+        {
+            x = cur_x;
+            y = cur_y;
+            cur_x++;
+            if(cur_x == 8)
+            {
+                cur_y--;
+                cur_x = 0;
+            }
+        }
+        return pos;
+    }
+
+    constexpr std::array<UVArr, 10> generate_number_uvs()
+    {
+        return generate_char_uvs<10>(generate_char_pos<10>(4, 1));
+    }
+    constexpr std::array<UVArr, 26> generate_lowerc_uvs()
+    {
+        return generate_char_uvs<26>(generate_char_pos<26>(0, 7));
+    }
+    constexpr std::array<UVArr, 26> generate_upperc_uvs()
+    {
+        return generate_char_uvs<26>(generate_char_pos<26>(2, 4));
+    }
+
+    inline constexpr auto number_uvs_arr = generate_number_uvs();
+    inline constexpr auto underscore_uvs_arr = generate_char_uvs<1>({{
+        {6, 0},
+    }});
+    inline constexpr auto colon_uvs_arr = generate_char_uvs<1>({{
+        {7, 0},
+    }});
+
+    inline constexpr auto lowerc_uvs_arr = generate_lowerc_uvs();
+    inline constexpr auto upperc_uvs_arr = generate_upperc_uvs();
+
+}
+
+UVArr Text::glyph_uvs(const char c)
+{
+    if(c == '_') return underscore_uvs_arr[0];
+    if(c == ':') return colon_uvs_arr[0];
+    if(c >= '0' && c <= '9') return number_uvs_arr[c - '0'];
+    if(c >= 'a' && c <= 'z') return lowerc_uvs_arr[c - 'a'];
+    if(c >= 'A' && c <= 'Z') return upperc_uvs_arr[c - 'A'];
+    return transparent_uvs;
+}
+
+TextRun::TextRun(const size_t first, const size_t length, const Layout& l)
+:
+first_quad(first), layout(l), shown(length, '\0'), shown_color(0.0f), written(false)
+{
+
+}
+
+bool TextRun::set(Buffer& buf, std::string_view text, const glm::vec4& color)
+{
+    const size_t length = shown.size();
+    auto cell_char = [&](const size_t i) {
+        return i < text.size() ? text[i] : '\0';
+    };
+
+    // the span that differs from what's there, all of it if the color changed
+    size_t lo = 0, hi = length;
+    if(written && color == shown_color)
+    {
+        while(lo < hi && cell_char(lo) == shown[lo]) ++lo;
+        while(hi > lo && cell_char(hi - 1) == shown[hi - 1]) --hi;
+    }
+    if(lo == hi) return false;
+
+    auto verts = buf.getQuads(first_quad + lo, hi - lo);
+    for(size_t i = lo; i < hi; ++i)
+    {
+        const char c = cell_char(i);
+        const auto [l_u, t_v, del_u, del_v] = Text::glyph_uvs(c);
+        const float x = layout.mirrored ? layout.origin.x - (i + 1) * layout.cell.x : layout.origin.x + i * layout.cell.x;
+        Fillers::fill_quad_generic(verts, first_quad + i,
+            PDD3{
+                {x, layout.origin.y, layout.origin.z},
+                {layout.cell.x, 0.0f, 0.0f},
+                {0.0f, layout.cell.y, 0.0f}
+            },
+            layout.mirrored ?
+            PDD2{
+                {l_u + del_u, t_v},
+                {-del_u, 0.0f},
+                {0.0f, del_v}
+            } :
+            PDD2{
+                {l_u, t_v},
+                {del_u, 0.0f},
+                {0.0f, del_v}
+            },
+        color);
+        shown[i] = c;
+    }
+    shown_color = color;
+    written = true;
+    return true;
+}
+
+void TextRun::move(Buffer& buf, const Layout& l)
+{
+    layout = l;
+    if(!written) return;
+
+    written = false;
+    const std::string text = shown;
+    set(buf, text, shown_color);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "fillers.h"
+
+#include <string>
+#include <string_view>
+#include <tuple>
+
+// left u, top v, then width and height of a glyph in the spritesheet
+using UVArr = std::tuple<float, float, float, float>;
+inline constexpr UVArr transparent_uvs{0.25f, 0.25f, 0.125f, 0.25f};
+
+namespace Text {
+    // '_', ' ', ':', digits and letters, anything else is transparent
+    UVArr glyph_uvs(const char c);
+}
+
+// a row of character cells in a Buffer, one quad each. it remembers what every cell shows,
+// so setting the text it already has writes nothing and new text only rewrites the cells
+// from the first to the last one that changed
+class TextRun {
+public:
+    struct Layout {
+        // top left of the first cell
+        glm::vec3 origin;
+        // width and height of a cell, cells follow each other along x
+        glm::vec2 cell;
+        // for text read from behind: cells go left of the origin and glyphs are flipped
+        bool mirrored;
+    };
+
+    TextRun(const size_t first_quad, const size_t length, const Layout& layout);
+
+    // cells past the end of text are left empty, text past the last cell is cut.
+    // returns whether anything was written
+    bool set(Buffer& buf, std::string_view text, const glm::vec4& color);
+    // writes what it shows again somewhere else
+    void move(Buffer& buf, const Layout& l);
+
+private:
+    size_t first_quad;
+    Layout layout;
+    // one char per cell, '\0' for empty ones
+    std::string shown;
+    glm::vec4 shown_color;
+    // nothing is known about the cells before the first set
+    bool written;
+};
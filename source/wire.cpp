@@ -0,0 +1,120 @@
+#include "wire.h"
+
+#include <cstring>
+
+WireWriter::WireWriter(unsigned char* out, size_t capacity)
+:
+data(out), capacity_bytes(capacity), pos(0), overflowed(false)
+{
+
+}
+
+void WireWriter::u8(uint8_t value)
+{
+    bytes(&value, 1);
+}
+
+void WireWriter::i8(int8_t value)
+{
+    u8(uint8_t(value));
+}
+
+void WireWriter::u16(uint16_t value)
+{
+    const unsigned char out[2] = {
+        uint8_t(value >> 8),
+        uint8_t(value),
+    };
+    bytes(out, sizeof(out));
+}
+
+void WireWriter::u32(uint32_t value)
+{
+    const unsigned char out[4] = {
+        uint8_t(value >> 24),
+        uint8_t(value >> 16),
+        uint8_t(value >> 8),
+        uint8_t(value),
+    };
+    bytes(out, sizeof(out));
+}
+
+void WireWriter::bytes(const void* in, size_t count)
+{
+    if(overflowed || count > capacity_bytes - pos)
+    {
+        overflowed = true;
+        return;
+    }
+
+    if(count) memcpy(data + pos, in, count);
+    pos += count;
+}
+
+size_t WireWriter::size() const
+{
+    return pos;
+}
+
+bool WireWriter::ok() const
+{
+    return !overflowed;
+}
+
+WireReader::WireReader(const unsigned char* in, size_t length)
+:
+data(in), length_bytes(length), pos(0), overflowed(false)
+{
+
+}
+
+const unsigned char* WireReader::take(size_t count)
+{
+    if(overflowed || count > length_bytes - pos)
+    {
+        overflowed = true;
+        return nullptr;
+    }
+
+    const auto at = data + pos;
+    pos += count;
+    return at;
+}
+
+uint8_t WireReader::u8()
+{
+    const auto at = take(1);
+    return at ? at[0] : 0;
+}
+
+int8_t WireReader::i8()
+{
+    return int8_t(u8());
+}
+
+uint16_t WireReader::u16()
+{
+    const auto at = take(2);
+    return at ? uint16_t((at[0] << 8) | at[1]) : 0;
+}
+
+uint32_t WireReader::u32()
+{
+    const auto at = take(4);
+    return at ? (uint32_t(at[0]) << 24) | (uint32_t(at[1]) << 16) | (uint32_t(at[2]) << 8) | uint32_t(at[3]) : 0;
+}
+
+const unsigned char* WireReader::bytes(size_t count)
+{
+    return take(count);
+}
+
+size_t WireReader::remaining() const
+{
+    return overflowed ? 0 : length_bytes - pos;
+}
+
+bool WireReader::ok() const
+{
+    return !overflowed;
+}
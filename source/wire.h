@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// packets go on the wire field by field in network byte order (big-endian), each field right after
+// the previous one, so the layout never depends on how a compiler sizes or pads a struct
+
+// writes fields one after the other into a buffer it doesn't own
+struct WireWriter {
+    WireWriter(unsigned char* out, size_t capacity);
+
+    void u8(uint8_t value);
+    void i8(int8_t value);
+    void u16(uint16_t value);
+    void u32(uint32_t value);
+    void bytes(const void* in, size_t length);
+    // bytes written so far
+    size_t size() const;
+    // false if something didn't fit
+    bool ok() const;
+
+private:
+    unsigned char* data;
+    size_t capacity_bytes;
+    size_t pos;
+    bool overflowed;
+};
+
+// read-only view over a received packet, fields are parsed in place and nothing is copied
+struct WireReader {
+    WireReader(const unsigned char* in, size_t length);
+
+    uint8_t u8();
+    int8_t i8();
+    uint16_t u16();
+    uint32_t u32();
+    // points into the packet, nullptr if there aren't that many bytes left
+    const unsigned char* bytes(size_t length);
+    size_t remaining() const;
+    // false if a read went past the end, reads then return 0
+    bool ok() const;
+
+private:
+    // the bytes of the next field, nullptr once past the end
+    const unsigned char* take(size_t length);
+
+    const unsigned char* data;
+    size_t length_bytes;
+    size_t pos;
+    bool overflowed;
+};